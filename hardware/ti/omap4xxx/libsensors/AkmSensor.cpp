@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "AkmSensor.h"
+
+#define AKM_INPUT_NAME	"compass"
+#define AKM_SYSFS_DIR	"/sys/class/compass/akm8975/"
+
+// event codes and scales of akmd come from the AK8975_FS headers, there is no safe default
+#if !defined(EVENT_TYPE_MAGV_X) || !defined(EVENT_TYPE_MAGV_STATUS) || !defined(EVENT_TYPE_YAW) \
+		|| !defined(EVENT_TYPE_ORIENT_STATUS) || !defined(CONVERT_M) || !defined(CONVERT_O)
+#error "AkmSensor needs hardware/akm/AK8975_FS/libsensors/sensors.h"
+#endif
+
+// sysfs attributes are named <attr>_mag and <attr>_ori
+static const char *sAttrSuffix[] = { "mag", "ori" };
+
+
+AkmSensor::AkmSensor ()
+	: SensorBase (NULL, AKM_INPUT_NAME),
+	  	mPendingMask (0),
+	  	mDropping (false),
+	  	mInputReader ((size_t)(INPUT_EVENTS))
+	 {
+
+	memset (mPendingEvents, 0, sizeof(mPendingEvents));
+	for (int i = 0; i < numSensors; i++) {
+		mActive[i] = false;
+		mPendingEvents[i].version = sizeof(sensors_event_t);
+	}
+
+	mPendingEvents[MagneticField].sensor = ID_AKM_MAGNETIC;
+	mPendingEvents[MagneticField].type = SENSOR_TYPE_MAGNETIC_FIELD;
+	mPendingEvents[MagneticField].magnetic.status = SENSOR_STATUS_UNRELIABLE;
+
+	mPendingEvents[Orientation].sensor = ID_AKM_ORIENTATION;
+	mPendingEvents[Orientation].type = SENSOR_TYPE_ORIENTATION;
+	mPendingEvents[Orientation].orientation.status = SENSOR_STATUS_UNRELIABLE;
+}
+
+AkmSensor::~AkmSensor () {
+	for (int i = 0; i < numSensors; i++) {
+		if (mActive[i]) {
+			writeControl ("enable", i, 0);
+		}
+	}
+}
+
+/*
+* The compass is optional, boards without akmd just don't list it.
+*/
+bool AkmSensor::isPresent () {
+	return access (AKM_SYSFS_DIR "enable_mag", F_OK) == 0;
+}
+
+int AkmSensor::handleToSensor (int32_t handle) const {
+	switch (handle) {
+		case ID_AKM_MAGNETIC:
+			return MagneticField;
+		case ID_AKM_ORIENTATION:
+			return Orientation;
+	}
+	return -EINVAL;
+}
+
+int AkmSensor::writeControl (const char *attr, int sensor, long long value) {
+	char path [PATH_MAX];
+	char buf [24];
+
+	snprintf (path, sizeof(path), "%s%s_%s", AKM_SYSFS_DIR, attr, sAttrSuffix[sensor]);
+	int len = snprintf (buf, sizeof(buf), "%lld", value);
+	return write_sys_attribute (path, buf, len) < 0 ? -EIO : 0;
+}
+
+/*
+* One state per sensor like ProximitySensor, akmd only runs the sensors in use.
+*/
+int AkmSensor::setEnable (int32_t handle, int enabled) {
+	int what = handleToSensor (handle);
+	bool active = enabled != 0;
+
+	if (what < 0) {
+		return what;
+	}
+	if (mActive[what] == active) {
+		return 0;
+	}
+	int err = writeControl ("enable", what, active ? 1 : 0);
+	if (!err) {
+		mActive[what] = active;
+	}
+	return err;
+}
+
+int AkmSensor::getEnable (int32_t handle) {
+	int what = handleToSensor (handle);
+	return what < 0 ? 0 : mActive[what];
+}
+
+/*
+* akmd takes the delay of every sensor in ns.
+*/
+int AkmSensor::setDelay (int32_t handle, int64_t ns) {
+	int what = handleToSensor (handle);
+
+	if (what < 0) {
+		return what;
+	}
+	if (ns < 0) {
+		return -EINVAL;
+	}
+	return writeControl ("delay", what, ns);
+}
+
+void AkmSensor::processEvent (int code, int value) {
+	switch (code) {
+		case EVENT_TYPE_MAGV_X:
+			mPendingMask |= 1 << MagneticField;
+			mPendingEvents[MagneticField].magnetic.x = value * CONVERT_M;
+			break;
+		case EVENT_TYPE_MAGV_Y:
+			mPendingMask |= 1 << MagneticField;
+			mPendingEvents[MagneticField].magnetic.y = value * CONVERT_M;
+			break;
+		case EVENT_TYPE_MAGV_Z:
+			mPendingMask |= 1 << MagneticField;
+			mPendingEvents[MagneticField].magnetic.z = value * CONVERT_M;
+			break;
+		case EVENT_TYPE_MAGV_STATUS:
+			mPendingMask |= 1 << MagneticField;
+			mPendingEvents[MagneticField].magnetic.status = value;
+			break;
+		case EVENT_TYPE_YAW:
+			mPendingMask |= 1 << Orientation;
+			mPendingEvents[Orientation].orientation.azimuth = value * CONVERT_O;
+			break;
+		case EVENT_TYPE_PITCH:
+			mPendingMask |= 1 << Orientation;
+			mPendingEvents[Orientation].orientation.pitch = value * CONVERT_O;
+			break;
+		case EVENT_TYPE_ROLL:
+			mPendingMask |= 1 << Orientation;
+			mPendingEvents[Orientation].orientation.roll = value * CONVERT_O;
+			break;
+		case EVENT_TYPE_ORIENT_STATUS:
+			mPendingMask |= 1 << Orientation;
+			mPendingEvents[Orientation].orientation.status = value;
+			break;
+	}
+}
+
+int AkmSensor::readEvents (sensors_event_t* data, int count) {
+	if (count < 1) {
+		return -EINVAL;
+	}
+	if (data_fd < 0) {
+		return 0;
+	}
+
+	ssize_t n = mInputReader.fill (data_fd);
+	if (n == -ENODEV) {
+		ALOGE ("AkmSensor: input device removed");
+		close (data_fd);
+		data_fd = -1;
+		return 0;
+	}
+	if (n < 0 && n != -EAGAIN) {
+		return n;
+	}
+
+	int numEventReceived = 0;
+	input_event const* events;
+	size_t available;
+
+	// one SYN_REPORT may complete an event for every sensor
+	while (count >= numSensors && (available = mInputReader.peek (&events))) {
+		size_t used;
+
+		for (used = 0; count >= numSensors && used < available; used++) {
+			input_event const* event = &events[used];
+
+			if (event->type == EV_SYN && event->code == SYN_DROPPED) {
+				// akmd reports every axis each cycle, the next complete report is consistent again
+				ALOGW ("AkmSensor: input events dropped");
+				mDropping = true;
+				mPendingMask = 0;
+			}
+			else if (event->type == EV_SYN && event->code == SYN_REPORT) {
+				int64_t time = eventTimestamp (event->time);
+				for (int i = 0; !mDropping && i < numSensors; i++) {
+					if ((mPendingMask & (1 << i)) && mActive[i]) {
+						mPendingEvents[i].timestamp = time;
+						*data++ = mPendingEvents[i];
+						count--;
+						numEventReceived++;
+					}
+				}
+				mPendingMask = 0;
+				mDropping = false;
+			}
+			else if (event->type == EV_ABS && !mDropping) {
+				processEvent (event->code, event->value);
+			}
+		}
+		mInputReader.consume (used);
+	}
+	return numEventReceived;
+}
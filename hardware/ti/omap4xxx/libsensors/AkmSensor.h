@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef AKM_SENSOR_H_
+#define AKM_SENSOR_H_
+
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "SensorBase.h"
+#include "InputEventReader.h"
+#include "sensors.h"
+
+struct input_event;
+
+
+/*
+* AK8975 compass. akmd computes magnetic field and orientation and publishes both
+* on the "compass" input device, they are switched and timed through sysfs.
+*/
+class AkmSensor : public SensorBase {
+private:
+	enum {
+		MagneticField = 0,
+		Orientation,
+		numSensors,
+	};
+	enum {
+		INPUT_EVENTS = 64,
+	};
+
+	bool mActive[numSensors];
+	uint32_t mPendingMask;	// sensors with new values since the last SYN_REPORT
+	bool mDropping;	// evdev dropped events, wait for the next SYN_REPORT
+	InputEventCircularReader mInputReader;
+	sensors_event_t mPendingEvents[numSensors];
+
+	int handleToSensor(int32_t handle) const;
+	int writeControl(const char *attr, int sensor, long long value);
+	void processEvent(int code, int value);
+
+public:
+	AkmSensor ();
+	virtual ~AkmSensor ();
+
+	static bool isPresent ();
+
+	virtual int readEvents (sensors_event_t* data, int count);
+	virtual int setDelay (int32_t handle, int64_t ns);
+    virtual int setEnable(int32_t handle, int enabled);
+    virtual int getEnable(int32_t handle);
+};
+
+
+#endif /* AKM_SENSOR_H_ */
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "AlphaBetaFilter.h"
+
+/*****************************************************************************/
+
+// samples further apart than this start over, the old velocity means nothing anymore. Well above
+// the slowest srf02 period, the kernel driver reports every sample, also an unchanged distance.
+#define MAX_GAP_NS          2500000000LL
+// weight of a new squared residual in the running variances
+#define VARIANCE_WEIGHT     0.1f
+
+AlphaBetaFilter::AlphaBetaFilter(float alpha, float beta)
+    : mAlpha(alpha),
+      mBeta(beta)
+{
+    reset();
+}
+
+void AlphaBetaFilter::reset()
+{
+    mValid = false;
+    mTime = 0;
+    mPosition = 0;
+    mVelocity = 0;
+    mPositionVar = 0;
+    mVelocityVar = 0;
+}
+
+void AlphaBetaFilter::update(int64_t time, float value)
+{
+    int64_t dtNs = time - mTime;
+
+    if (!mValid || dtNs <= 0 || dtNs > MAX_GAP_NS) {
+        bool restart = mValid;
+        mValid = true;
+        mTime = time;
+        mPosition = value;
+        mVelocity = 0;
+        if (!restart) {
+            mPositionVar = 0;
+            mVelocityVar = 0;
+        }
+        return;
+    }
+
+    const float dt = dtNs / 1000000000.0f;
+    const float predicted = mPosition + mVelocity * dt;
+    const float residual = value - predicted;
+    const float velocityCorrection = mBeta / dt * residual;
+
+    mPosition = predicted + mAlpha * residual;
+    mVelocity += velocityCorrection;
+    mTime = time;
+
+    mPositionVar += VARIANCE_WEIGHT * (residual * residual - mPositionVar);
+    mVelocityVar += VARIANCE_WEIGHT *
+            (velocityCorrection * velocityCorrection - mVelocityVar);
+}
+
+float AlphaBetaFilter::position(int64_t time) const
+{
+    return mPosition + mVelocity * ((time - mTime) / 1000000000.0f);
+}
+
+float AlphaBetaFilter::uncertainty(int64_t time) const
+{
+    const float horizon = (time - mTime) / 1000000000.0f;
+    return sqrtf(mPositionVar + mVelocityVar * horizon * horizon);
+}
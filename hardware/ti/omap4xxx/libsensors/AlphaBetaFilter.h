@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ALPHA_BETA_FILTER_H
+#define ANDROID_ALPHA_BETA_FILTER_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Alpha-beta tracker of a distance over timestamped samples. Estimates the
+ * distance and its rate of change and extrapolates both to any later time,
+ * which hides the acquisition latency of slow sensors.
+ */
+class AlphaBetaFilter
+{
+    const float mAlpha;         // weight of the residual for the position
+    const float mBeta;          // weight of the residual for the velocity
+    bool mValid;
+    int64_t mTime;              // ns of the last sample
+    float mPosition;
+    float mVelocity;            // per second
+    float mPositionVar;         // running variance of the residuals
+    float mVelocityVar;
+
+public:
+    AlphaBetaFilter(float alpha, float beta);
+
+    void reset();
+    void update(int64_t time, float value);
+
+    bool isValid() const { return mValid; }
+    float position(int64_t time) const;
+    float velocity() const { return mVelocity; }
+    /* one sigma of position(time), grows with the extrapolation horizon */
+    float uncertainty(int64_t time) const;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_ALPHA_BETA_FILTER_H
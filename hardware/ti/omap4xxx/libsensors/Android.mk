@@ -15,13 +15,22 @@ LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\"
 LOCAL_SRC_FILES :=  \
 	SensorBase.cpp\
 	InputEventReader.cpp\
+	SensorEventRing.cpp \
+	ThreadedSensor.cpp \
+	AlphaBetaFilter.cpp \
+	NearestObstacleSensor.cpp \
+	AkmSensor.cpp \
+	DirectChannel.cpp \
 	sensors.cpp \
-	proximity_sensor.cpp
+	proximity_sensor.cpp \
+	I2cProximitySensor.cpp
 	
 	
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SHARED_LIBRARIES := liblog libcutils
 
 LOCAL_MODULE_TAGS := eng #for test with eng?
 
 include $(BUILD_SHARED_LIBRARY)
 
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
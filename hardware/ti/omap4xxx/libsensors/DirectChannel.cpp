@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+
+#include "DirectChannel.h"
+
+/*****************************************************************************/
+
+DirectChannel::DirectChannel(int fd, size_t size)
+    : mFd(-1),
+      mBuffer(NULL),
+      mSize(size),
+      mNumEvents(size / sizeof(sensors_event_t)),
+      mPos(0),
+      mCounter(0)
+{
+    if (fd < 0 || mNumEvents == 0) {
+        ALOGE("DirectChannel: invalid memory (fd %d, %zu bytes)", fd, size);
+        return;
+    }
+    mFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (mFd < 0) {
+        ALOGE("DirectChannel: dup failed (%s)", strerror(errno));
+        return;
+    }
+    void* addr = mmap(NULL, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("DirectChannel: mmap failed (%s)", strerror(errno));
+        return;
+    }
+    mBuffer = static_cast<sensors_event_t*>(addr);
+    // no slot is valid before the first write
+    memset(mBuffer, 0, mNumEvents * sizeof(sensors_event_t));
+}
+
+DirectChannel::~DirectChannel()
+{
+    if (mBuffer) {
+        munmap(mBuffer, mSize);
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+void DirectChannel::write(sensors_event_t const& event, int32_t token)
+{
+    sensors_event_t* slot = &mBuffer[mPos];
+    volatile int32_t* counter = &slot->reserved0;
+
+    if (++mCounter == 0) {
+        mCounter = 1;
+    }
+    // invalidate the slot before the payload changes under a reader
+    android_atomic_release_store(0, counter);
+    android_memory_barrier();
+    slot->version = event.version;
+    slot->sensor = token;
+    slot->type = event.type;
+    slot->timestamp = event.timestamp;
+    memcpy(slot->data, event.data, sizeof(slot->data));
+    memset(slot->reserved1, 0, sizeof(slot->reserved1));
+    // the counter publishes the payload
+    android_atomic_release_store(mCounter, counter);
+
+    if (++mPos == mNumEvents) {
+        mPos = 0;
+    }
+}
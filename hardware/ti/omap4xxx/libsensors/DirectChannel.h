@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DIRECT_CHANNEL_H
+#define ANDROID_DIRECT_CHANNEL_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+
+/*****************************************************************************/
+
+/*
+ * Shared memory ring of a direct report channel, see sensors_direct.h. Only
+ * the engine thread writes, the clients read it without any call into the HAL.
+ */
+class DirectChannel
+{
+    int mFd;                    // own reference, the client may close its fd
+    sensors_event_t* mBuffer;
+    size_t mSize;               // bytes mapped
+    size_t mNumEvents;
+    size_t mPos;
+    int32_t mCounter;
+
+public:
+    DirectChannel(int fd, size_t size);
+    ~DirectChannel();
+
+    bool isValid() const { return mBuffer != NULL; }
+
+    /* Copies event into the next slot with event.sensor = token. */
+    void write(sensors_event_t const& event, int32_t token);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_DIRECT_CHANNEL_H
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "I2cProximitySensor.h"
+
+// registers and commands of the srf02
+#define SRF02_REG_COMMAND	(0x00)
+#define SRF02_REG_RANGE_HIGH	(0x02)
+#define SRF02_CMD_RANGE_CM	(0x51)
+// the datasheet allows 65 ms for a ranging, the chip does not answer on the bus before
+#define SRF02_RANGING_NS	(66000000LL)
+#define SRF02_MAX_RANGE_CM	(600.0f)
+#define SRF02_DEFAULT_PERIOD_NS	(100000000LL)
+
+
+static int parseSpec (const char *spec, int *bus, int *address) {
+	if (sscanf (spec, "%d:%i", bus, address) != 2 || *bus < 0
+			|| *address < 0x03 || *address > 0x77) {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+* spec is "<bus>:<address>" of the srf02, it has to stay valid for the lifetime of the sensor.
+*/
+I2cProximitySensor::I2cProximitySensor (const char *spec, int handle)
+	: ProximitySensor (handle),
+	  	mI2cFd (-1),
+	  	mAddress (0),
+	  	mState (IDLE),
+	  	mPeriodNs (SRF02_DEFAULT_PERIOD_NS),
+	  	mFireTime (0)
+	 {
+
+	char path [PATH_MAX];
+	int bus;
+
+	if (parseSpec (spec, &bus, &mAddress) < 0) {
+		ALOGE ("I2cProximitySensor: invalid device '%s'", spec);
+		return;
+	}
+	snprintf (path, sizeof(path), "/dev/i2c-%d", bus);
+	mI2cFd = open (path, O_RDWR | O_CLOEXEC);
+	if (mI2cFd < 0) {
+		ALOGE ("I2cProximitySensor: couldn't open %s (%s)", path, strerror(errno));
+		return;
+	}
+
+	// the poll loop reads this like an input device
+	data_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	ALOGE_IF (data_fd < 0, "I2cProximitySensor: couldn't create timerfd (%s)", strerror(errno));
+	data_clock = CLOCK_MONOTONIC;
+	mSampleLatencyNs = SRF02_RANGING_NS / 2;
+}
+
+I2cProximitySensor::~I2cProximitySensor () {
+	// ProximitySensor only sees the stopped state then
+	enable (0, 0);
+	if (mI2cFd >= 0) {
+		close (mI2cFd);
+	}
+}
+
+/*
+* The config comes from a property, nothing has to be probed.
+*/
+bool I2cProximitySensor::isConfigured () {
+	char value [PROPERTY_VALUE_MAX];
+
+	return property_get (SRF02_I2C_PROPERTY, value, NULL) > 0;
+}
+
+/*
+* Split SRF02_I2C_PROPERTY into one spec per srf02, in the order given.
+*/
+int I2cProximitySensor::findDevices (char (*specs)[PATH_MAX], int max) {
+	char value [PROPERTY_VALUE_MAX];
+	char *save = NULL;
+	int count = 0;
+
+	property_get (SRF02_I2C_PROPERTY, value, "");
+	for (char *token = strtok_r (value, ", ", &save); token && count < max;
+			token = strtok_r (NULL, ", ", &save)) {
+		int bus, address;
+
+		if (parseSpec (token, &bus, &address) < 0) {
+			ALOGE ("I2cProximitySensor: ignoring invalid device '%s'", token);
+			continue;
+		}
+		snprintf (specs[count], PATH_MAX, "%s", token);
+		count++;
+	}
+	return count;
+}
+
+/*
+* Without the kernel driver nothing was measured at probe, the limits are the datasheet ones.
+*/
+int I2cProximitySensor::fillSensorInfo (const char *spec, struct sensor_t *sensor, char *name, size_t nameLen) {
+	int bus, address;
+
+	if (parseSpec (spec, &bus, &address) < 0) {
+		return -EINVAL;
+	}
+	snprintf (name, nameLen, "SRF02 Proximity Sensor (i2c-%d 0x%02x)", bus, address);
+	sensor->name = name;
+	sensor->minDelay = SRF02_RANGING_NS / 1000;
+	sensor->maxRange = SRF02_MAX_RANGE_CM;
+	sensor->resolution = 1.0f;
+	return 0;
+}
+
+/*
+* Combined transaction, no other master can get in between the messages.
+*/
+int I2cProximitySensor::transfer (struct i2c_msg *msgs, int num) {
+	struct i2c_rdwr_ioctl_data rdwr;
+
+	if (mI2cFd < 0) {
+		return -ENODEV;
+	}
+	rdwr.msgs = msgs;
+	rdwr.nmsgs = num;
+	if (ioctl (mI2cFd, I2C_RDWR, &rdwr) < 0) {
+		return -errno;
+	}
+	return 0;
+}
+
+int I2cProximitySensor::fire () {
+	uint8_t cmd[2] = { SRF02_REG_COMMAND, SRF02_CMD_RANGE_CM };
+	struct i2c_msg msg;
+
+	msg.addr = mAddress;
+	msg.flags = 0;
+	msg.len = sizeof(cmd);
+	msg.buf = cmd;
+	return transfer (&msg, 1);
+}
+
+/*
+* Register pointer and the two range bytes in one transaction.
+*/
+int I2cProximitySensor::fetch (int *cm) {
+	uint8_t reg = SRF02_REG_RANGE_HIGH;
+	uint8_t range[2];
+	struct i2c_msg msgs[2];
+
+	msgs[0].addr = mAddress;
+	msgs[0].flags = 0;
+	msgs[0].len = 1;
+	msgs[0].buf = &reg;
+	msgs[1].addr = mAddress;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = sizeof(range);
+	msgs[1].buf = range;
+
+	int err = transfer (msgs, 2);
+	if (err < 0) {
+		return err;
+	}
+	*cm = (range[0] << 8) | range[1];
+	return 0;
+}
+
+/*
+* One shot at the absolute CLOCK_MONOTONIC time when, 0 disarms.
+*/
+int I2cProximitySensor::armTimer (int64_t when) {
+	struct itimerspec spec;
+
+	memset (&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = when / 1000000000LL;
+	spec.it_value.tv_nsec = when % 1000000000LL;
+	if (timerfd_settime (data_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+		ALOGE ("I2cProximitySensor: timerfd_settime failed (%s)", strerror(errno));
+		return -errno;
+	}
+	return 0;
+}
+
+/*
+* A failed command only costs this cycle, the next one is tried a period later.
+*/
+void I2cProximitySensor::fireOrRetry (int64_t now) {
+	int err = fire();
+
+	mFireTime = now;
+	if (err < 0) {
+		ALOGE ("I2cProximitySensor: ranging command failed (%s)", strerror(-err));
+		mState = WAITING;
+		armTimer (now + mPeriodNs);
+		return;
+	}
+	mState = RANGING;
+	armTimer (now + SRF02_RANGING_NS);
+}
+
+/*
+* Nothing is queued in the kernel, there is nothing to keep the system awake for.
+*/
+void I2cProximitySensor::updateSuspendBlock () {
+}
+
+int I2cProximitySensor::enable (int32_t handle, int en) {
+	int newState = en ? 1 : 0;
+
+	if (newState == mEnabled) {
+		return 0;
+	}
+	if (data_fd < 0 || mI2cFd < 0) {
+		return -ENODEV;
+	}
+	if (newState) {
+		setInitialState();
+		fireOrRetry (getTimestamp());
+	}
+	else {
+		armTimer (0);
+		mState = IDLE;
+	}
+	mEnabled = newState;
+	return 0;
+}
+
+/*
+* The next fire is scheduled from the last one, so a new period applies from the next cycle.
+*/
+int I2cProximitySensor::setDelay (int32_t handle, int64_t ns) {
+	mPeriodNs = ns < SRF02_RANGING_NS ? SRF02_RANGING_NS : ns;
+	return 0;
+}
+
+int I2cProximitySensor::readEvents (sensors_event_t* data, int count) {
+	uint64_t expirations;
+
+	if (count < 1) {
+		return -EINVAL;
+	}
+	if (initialEventsPending()) {
+		return report(data, count, getTimestamp(), false);
+	}
+	// one sample may become an event for every active output, the timer stays readable
+	if (count < activeOutputs() || data_fd < 0) {
+		return 0;
+	}
+	if (read (data_fd, &expirations, sizeof(expirations)) < 0) {
+		return errno == EAGAIN ? 0 : -errno;
+	}
+
+	int64_t now = getTimestamp();
+	int numEventRecieved = 0;
+	int cm;
+
+	switch (mState) {
+		case RANGING: {
+			int err = fetch (&cm);
+			if (err < 0) {
+				// same as a failed measurement of the kernel driver, drop this sample
+				ALOGI_IF (DEBUG, "I2cProximitySensor: invalid sample (%s)", strerror(-err));
+				numEventRecieved = reportFailure(data, count, now);
+			}
+			else {
+				mPendingEvent.distance = cm;
+				newSample(now);
+				numEventRecieved = report(data, count, now, true);
+			}
+			mState = WAITING;
+			// keep the cadence of the fires, late cycles fire right away
+			int64_t next = mFireTime + mPeriodNs;
+			armTimer (next > now ? next : now + 1);
+			break;
+		}
+		case WAITING:
+			fireOrRetry (now);
+			break;
+		default:
+			break;
+	}
+	return numEventRecieved;
+}
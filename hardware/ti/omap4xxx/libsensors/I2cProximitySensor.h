@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef I2C_PROXIMITY_SENSOR_H_
+#define I2C_PROXIMITY_SENSOR_H_
+
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "proximity_sensor.h"
+
+// set to "<bus>:<address>,..." e.g. "3:0x70,3:0x71" to drive the srf02s through i2c-dev
+// instead of the kernel driver
+#define SRF02_I2C_PROPERTY	"ro.sensors.srf02.i2c"
+
+
+/*
+* SRF02 ranged from user space through /dev/i2c-N, for systems without the kernel driver.
+* getFd() is a timerfd, readEvents() runs one step of the ranging cycle per expiry:
+* fire the ranging command, fetch the result ranging time later, fire again one period
+* after the last fire. The outputs are the ones of ProximitySensor.
+*/
+class I2cProximitySensor : public ProximitySensor {
+private:
+	enum {
+		IDLE,
+		RANGING,	// command sent, result not ready
+		WAITING,	// result fetched, next fire due
+	};
+
+	int mI2cFd;
+	int mAddress;
+	int mState;
+	int64_t mPeriodNs;
+	int64_t mFireTime;	// CLOCK_MONOTONIC of the last ranging command
+
+	int transfer(struct i2c_msg *msgs, int num);
+	int fire();
+	int fetch(int *cm);
+	int armTimer(int64_t when);
+	void fireOrRetry(int64_t now);
+	virtual void updateSuspendBlock();
+
+public:
+	I2cProximitySensor (const char *spec, int handle);
+	virtual ~I2cProximitySensor ();
+	virtual int readEvents (sensors_event_t* data, int count);
+	virtual int enable (int32_t handle, int enabled);
+	virtual int setDelay(int32_t handle, int64_t ns);
+
+	static bool isConfigured ();
+	static int findDevices (char (*specs)[PATH_MAX], int max);
+	static int fillSensorInfo (const char *spec, struct sensor_t *sensor, char *name, size_t nameLen);
+};
+
+
+#endif /* I2C_PROXIMITY_SENSOR_H_ */
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <errno.h>
 #include <unistd.h>
+#include <string.h>
 #include <poll.h>
 
 #include <sys/cdefs.h>
@@ -33,11 +34,10 @@
 struct input_event;
 
 InputEventCircularReader::InputEventCircularReader(size_t numEvents)
-    : mBuffer(new input_event[numEvents * 2]),
-      mBufferEnd(mBuffer + numEvents),
-      mHead(mBuffer),
-      mCurr(mBuffer),
-      mFreeSpace(numEvents)
+    : mBuffer(new input_event[numEvents]),
+      mCapacity(numEvents),
+      mHead(0),
+      mCurr(0)
 {
 }
 
@@ -49,40 +49,48 @@ InputEventCircularReader::~InputEventCircularReader()
 ssize_t InputEventCircularReader::fill(int fd)
 {
     size_t numEventsRead = 0;
-    if (mFreeSpace) {
-        const ssize_t nread = read(fd, mHead, mFreeSpace * sizeof(input_event));
+
+    if (mCurr) {
+        // move the leftover, usually a partial sample, to the front
+        memmove(mBuffer, mBuffer + mCurr, (mHead - mCurr) * sizeof(input_event));
+        mHead -= mCurr;
+        mCurr = 0;
+    }
+    if (mHead < mCapacity) {
+        const ssize_t nread = read(fd, mBuffer + mHead,
+                (mCapacity - mHead) * sizeof(input_event));
         if (nread<0 || nread % sizeof(input_event)) {
             // we got a partial event!!
             return nread<0 ? -errno : -EINVAL;
         }
 
         numEventsRead = nread / sizeof(input_event);
-        if (numEventsRead) {
-            mHead += numEventsRead;
-            mFreeSpace -= numEventsRead;
-            if (mHead > mBufferEnd) {
-                size_t s = mHead - mBufferEnd;
-                memcpy(mBuffer, mBufferEnd, s * sizeof(input_event));
-                mHead = mBuffer + s;
-            }
-        }
+        mHead += numEventsRead;
     }
 
     return numEventsRead;
 }
 
+size_t InputEventCircularReader::peek(input_event const** events) const
+{
+    *events = mBuffer + mCurr;
+    return mHead - mCurr;
+}
+
+void InputEventCircularReader::consume(size_t count)
+{
+    mCurr += count;
+    if (mCurr >= mHead) {
+        mCurr = mHead = 0;
+    }
+}
+
 ssize_t InputEventCircularReader::readEvent(input_event const** events)
 {
-    *events = mCurr;
-    ssize_t available = (mBufferEnd - mBuffer) - mFreeSpace;
-    return available ? 1 : 0;
+    return peek(events) ? 1 : 0;
 }
 
 void InputEventCircularReader::next()
 {
-    mCurr++;
-    mFreeSpace++;
-    if (mCurr >= mBufferEnd) {
-        mCurr = mBuffer;
-    }
+    consume(1);
 }
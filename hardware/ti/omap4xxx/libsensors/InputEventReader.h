@@ -26,18 +26,28 @@
 
 struct input_event;
 
+/*
+ * Buffers input_events of one input device. Unconsumed events are kept at the
+ * start of the buffer, so fill() needs a single read() and everything read so
+ * far is one contiguous span.
+ */
 class InputEventCircularReader
 {
     struct input_event* const mBuffer;
-    struct input_event* const mBufferEnd;
-    struct input_event* mHead;
-    struct input_event* mCurr;
-    ssize_t mFreeSpace;
+    const size_t mCapacity;
+    size_t mHead;   // end of the events read so far
+    size_t mCurr;   // first event not consumed yet
 
 public:
     InputEventCircularReader(size_t numEvents);
     ~InputEventCircularReader();
     ssize_t fill(int fd);
+
+    /* Contiguous span of all unconsumed events, returns its length. */
+    size_t peek(input_event const** events) const;
+    void consume(size_t count);
+
+    /* One event at a time, same as peek()/consume(1). */
     ssize_t readEvent(input_event const** events);
     void next();
 };
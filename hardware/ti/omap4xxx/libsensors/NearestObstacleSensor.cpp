@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "NearestObstacleSensor.h"
+
+
+NearestObstacleSensor::NearestObstacleSensor (int handle, int numSources)
+	: SensorBase (NULL, NULL),
+	  	mHandle (handle),
+	  	mNumSources (numSources),
+	  	mActive (false),
+	  	mNearest (-1),
+	  	mNewest (0),
+	  	mHasPendingEvent (false)
+	 {
+
+	memset (mTimestamp, 0, sizeof(mTimestamp));
+	memset (&mPendingEvent, 0, sizeof(mPendingEvent));
+	mPendingEvent.version = sizeof(sensors_event_t);
+	mPendingEvent.sensor = mHandle;
+	mPendingEvent.type = SENSOR_TYPE_NEAREST_OBSTACLE;
+}
+
+NearestObstacleSensor::~NearestObstacleSensor () {
+}
+
+bool NearestObstacleSensor::hasSample (int source) const {
+	return mTimestamp[source] != 0;
+}
+
+void NearestObstacleSensor::findNearest () {
+	mNearest = -1;
+	for (int i = 0; i < mNumSources; i++) {
+		if (hasSample (i) && (mNearest < 0 || mDistance[i] < mDistance[mNearest])) {
+			mNearest = i;
+		}
+	}
+}
+
+/*
+* Called for every sample of a source. Only a sample or failure of the current nearest
+* needs a scan over all sources. The srf02s are on-change sources, no sample for a while
+* means nothing moved, so sources never expire by time.
+*/
+void NearestObstacleSensor::addSample (int source, sensors_event_t const& event) {
+	if (source < 0 || source >= mNumSources || !mActive) {
+		return;
+	}
+	int lastNearest = mNearest;
+	float lastDistance = mNearest < 0 ? -1 : mDistance[mNearest];
+
+	if (event.distance == FUSION_SOURCE_FAILED) {
+		// the source does not count until it measures again
+		mTimestamp[source] = 0;
+		if (source == mNearest) {
+			findNearest ();
+		}
+	}
+	else {
+		mDistance[source] = event.distance;
+		mTimestamp[source] = event.timestamp;
+		if (event.timestamp > mNewest) {
+			mNewest = event.timestamp;
+		}
+		if (mNearest < 0 || source == mNearest) {
+			findNearest ();
+		}
+		else if (event.distance < mDistance[mNearest]) {
+			mNearest = source;
+		}
+	}
+	if (mNearest < 0) {
+		return;
+	}
+
+	if (mNearest != lastNearest || mDistance[mNearest] != lastDistance) {
+		// coalesces with an event not delivered yet, only the latest state matters
+		mPendingEvent.distance = mDistance[mNearest];
+		mPendingEvent.data[1] = mNearest;
+		mPendingEvent.timestamp = mNewest;
+		mHasPendingEvent = true;
+	}
+}
+
+int NearestObstacleSensor::readEvents (sensors_event_t* data, int count) {
+	if (count < 1 || !mHasPendingEvent) {
+		return 0;
+	}
+	mHasPendingEvent = false;
+	*data = mPendingEvent;
+	// age at delivery, includes the time the event spent in the HAL
+	data->data[2] = (getTimestamp() - mNewest) / 1000000.0f;
+	return 1;
+}
+
+bool NearestObstacleSensor::hasPendingEvents () const {
+	return mHasPendingEvent;
+}
+
+/*
+* Idempotent like activate().
+*/
+int NearestObstacleSensor::setEnable (int32_t handle, int enabled) {
+	if (mActive == !!enabled) {
+		return 0;
+	}
+	mActive = enabled;
+	if (enabled) {
+		// samples from a previous activation are no obstacles anymore
+		memset (mTimestamp, 0, sizeof(mTimestamp));
+		mNearest = -1;
+		mNewest = 0;
+	}
+	else {
+		mHasPendingEvent = false;
+	}
+	return 0;
+}
+
+int NearestObstacleSensor::getEnable (int32_t handle) {
+	return mActive;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef NEAREST_OBSTACLE_SENSOR_H_
+#define NEAREST_OBSTACLE_SENSOR_H_
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "SensorBase.h"
+#include "sensors.h"
+
+
+/*
+* Virtual sensor fusing all srf02s into the nearest distance any of them sees. It has
+* no fd, the poll context hands it every sample of the FUSION_SOURCE_HANDLEs through
+* addSample() and marks it ready when hasPendingEvents(). A source counts from its first
+* sample until it reports a failed one (FUSION_SOURCE_FAILED) or the sensor is disabled,
+* a silent source still sees the same obstacle.
+*/
+class NearestObstacleSensor : public SensorBase {
+private:
+	int mHandle;
+	int mNumSources;
+	bool mActive;
+	float mDistance [MAX_SRF02_SENSORS];	// latest sample of every source
+	int64_t mTimestamp [MAX_SRF02_SENSORS];	// 0 if there is none or the last one failed
+	int mNearest;	// source with the smallest distance, -1 if none
+	int64_t mNewest;	// timestamp of the freshest sample, CLOCK_MONOTONIC like getTimestamp()
+	sensors_event_t mPendingEvent;
+	bool mHasPendingEvent;
+
+	bool hasSample (int source) const;
+	void findNearest ();
+
+public:
+	NearestObstacleSensor (int handle, int numSources);
+	virtual ~NearestObstacleSensor ();
+
+	void addSample (int source, sensors_event_t const& event);
+
+	virtual int readEvents (sensors_event_t* data, int count);
+	virtual bool hasPendingEvents () const;
+	virtual int setEnable (int32_t handle, int enabled);
+	virtual int getEnable (int32_t handle);
+};
+
+
+#endif /* NEAREST_OBSTACLE_SENSOR_H_ */
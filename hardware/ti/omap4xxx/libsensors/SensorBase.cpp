@@ -20,6 +20,7 @@
 #include <poll.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <stdlib.h>
 #include <sys/select.h>
 
 #include <cutils/log.h>
@@ -32,9 +33,10 @@
 
 SensorBase::SensorBase(
         const char* dev_name,
-        const char* data_name)
-    : dev_name(dev_name), data_name(data_name),
-      dev_fd(-1), data_fd(-1)
+        const char* data_name,
+        const char* data_dir)
+    : dev_name(dev_name), data_name(data_name), data_dir(data_dir),
+      dev_fd(-1), data_fd(-1), data_clock(CLOCK_REALTIME)
 {
     if (data_name) {
         data_fd = openInput(data_name);
@@ -87,6 +89,41 @@ int SensorBase::write_sys_attribute(
 	return amt;
 }
 
+int SensorBase::read_sys_attribute(
+	const char *path, char *value, int bytes)
+{
+    int fd, amt;
+
+	fd = open(path, O_RDONLY);
+    if (fd < 0) {
+       ALOGE("SensorBase: read_attr failed to open %s (%s)",
+			path, strerror(errno));
+        return -1;
+	}
+
+    amt = read(fd, value, bytes - 1);
+	if (amt < 0) {
+		amt = -errno;
+		ALOGE("SensorBase: read_attr failed to read %s (%s)",
+			path, strerror(errno));
+	} else {
+		value[amt] = '\0';
+	}
+    close(fd);
+	return amt;
+}
+
+int SensorBase::read_int(const char *path, int *value)
+{
+    char buf[16];
+    int amt = read_sys_attribute(path, buf, sizeof(buf));
+    if (amt <= 0) {
+        return amt < 0 ? amt : -EINVAL;
+    }
+    *value = atoi(buf);
+    return 0;
+}
+
 int SensorBase::getFd() const {
     if (!data_name) {
         return dev_fd;
@@ -94,6 +131,24 @@ int SensorBase::getFd() const {
     return data_fd;
 }
 
+bool SensorBase::handleHotplug() {
+    if (!data_name) {
+        return false;
+    }
+    if (data_fd >= 0) {
+        char name[80];
+        // a removed input device fails every ioctl with ENODEV
+        if (ioctl(data_fd, EVIOCGNAME(sizeof(name) - 1), &name) >= 0) {
+            return false;
+        }
+        close(data_fd);
+        data_fd = -1;
+    }
+    data_fd = openInput(data_name);
+    ALOGI("SensorBase: '%s' reopened, data_fd = %d", data_name, data_fd);
+    return data_fd >= 0;
+}
+
 int SensorBase::setDelay(int32_t handle, int64_t ns) {
     return 0;
 }
@@ -113,42 +168,218 @@ int64_t SensorBase::getTimestamp() {
     return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
 }
 
-int SensorBase::openInput(const char* inputName) {
+/*
+ * Input event time in the clock of getTimestamp(). Without EVIOCSCLOCKID the
+ * event is in CLOCK_REALTIME and gets shifted by the current clock offset.
+ */
+int64_t SensorBase::eventTimestamp(timeval const& t) const {
+    int64_t time = timevalToNano(t);
+    if (data_clock != CLOCK_MONOTONIC) {
+        struct timespec now;
+        now.tv_sec = now.tv_nsec = 0;
+        clock_gettime(data_clock, &now);
+        time += getTimestamp() - (int64_t(now.tv_sec)*1000000000LL + now.tv_nsec);
+    }
+    return time;
+}
+
+/*
+ * evdev stamps events with CLOCK_REALTIME unless told otherwise, Android wants
+ * the same clock as getTimestamp(). Older kernels don't know EVIOCSCLOCKID.
+ */
+void SensorBase::setEventClock(int fd) {
+    data_clock = CLOCK_REALTIME;
+#ifdef EVIOCSCLOCKID
+    int clk = CLOCK_MONOTONIC;
+    if (ioctl(fd, EVIOCSCLOCKID, &clk) == 0) {
+        data_clock = CLOCK_MONOTONIC;
+    }
+#endif
+}
+
+SensorBase::InputIndexEntry SensorBase::sInputIndex[SensorBase::MAX_INPUT_DEVICES];
+int SensorBase::sInputIndexCount = 0;
+bool SensorBase::sInputIndexValid = false;
+pthread_mutex_t SensorBase::sInputIndexLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Reads /sys/class/input/eventN/device/name for every event node. Nothing
+ * in /dev/input gets opened, so unrelated devices are never touched.
+ */
+void SensorBase::buildInputIndex() {
+    const char *dirname = "/sys/class/input";
+    char path[PATH_MAX];
+    DIR *dir;
+    struct dirent *de;
+
+    sInputIndexCount = 0;
+    sInputIndexValid = true;
+    dir = opendir(dirname);
+    if (dir == NULL) {
+        ALOGE("SensorBase couldn't open %s (%s)", dirname, strerror(errno));
+        return;
+    }
+    while ((de = readdir(dir))) {
+        if (strncmp(de->d_name, "event", 5))
+            continue;
+        if (sInputIndexCount == MAX_INPUT_DEVICES) {
+            // openInput() falls back to scanInput() for whatever is missing
+            ALOGW("SensorBase: more than %d input devices, index truncated", MAX_INPUT_DEVICES);
+            break;
+        }
+        InputIndexEntry& entry(sInputIndex[sInputIndexCount]);
+        snprintf(path, sizeof(path), "%s/%s/device/name", dirname, de->d_name);
+        if (read_sys_attribute(path, entry.name, sizeof(entry.name)) <= 0)
+            continue;
+        // strip trailing newline
+        entry.name[strcspn(entry.name, "\n")] = '\0';
+        strncpy(entry.node, de->d_name, sizeof(entry.node) - 1);
+        entry.node[sizeof(entry.node) - 1] = '\0';
+        sInputIndexCount++;
+    }
+    closedir(dir);
+}
+
+/* Called with sInputIndexLock held. */
+const char* SensorBase::lookupInputNode(const char* inputName) {
+    if (!sInputIndexValid) {
+        buildInputIndex();
+    }
+    for (int i = 0; i < sInputIndexCount; i++) {
+        if (!strcmp(sInputIndex[i].name, inputName)) {
+            return sInputIndex[i].node;
+        }
+    }
+    return NULL;
+}
+
+void SensorBase::invalidateInputIndex() {
+    pthread_mutex_lock(&sInputIndexLock);
+    sInputIndexValid = false;
+    pthread_mutex_unlock(&sInputIndexLock);
+}
+
+/*
+ * Several devices may register input devices with the same name, so with a
+ * data_dir only the input devices below that sysfs device are considered.
+ */
+int SensorBase::openInputIn(const char* sysfsDir, const char* inputName) {
     int fd = -1;
-    const char *dirname = "/dev/input";
-    char devname[PATH_MAX];
-    char *filename;
+    char path[PATH_MAX];
+    char name[80];
+    DIR *dir, *inputDir;
+    struct dirent *de, *ie;
+
+    snprintf(path, sizeof(path), "%sinput", sysfsDir);
+    dir = opendir(path);
+    if (dir == NULL) {
+        ALOGE("SensorBase couldn't open %s (%s)", path, strerror(errno));
+        return -1;
+    }
+    while (fd < 0 && (de = readdir(dir))) {
+        if (strncmp(de->d_name, "input", 5))
+            continue;
+        snprintf(path, sizeof(path), "%sinput/%s/name", sysfsDir, de->d_name);
+        if (read_sys_attribute(path, name, sizeof(name)) <= 0)
+            continue;
+        name[strcspn(name, "\n")] = '\0';
+        if (strcmp(name, inputName))
+            continue;
+
+        snprintf(path, sizeof(path), "%sinput/%s", sysfsDir, de->d_name);
+        inputDir = opendir(path);
+        if (inputDir == NULL)
+            continue;
+        while ((ie = readdir(inputDir))) {
+            if (strncmp(ie->d_name, "event", 5))
+                continue;
+            snprintf(path, sizeof(path), "/dev/input/%s", ie->d_name);
+            fd = open(path, O_RDONLY | O_NONBLOCK);
+            if (fd >= 0) {
+                strcpy(input_name, ie->d_name);
+                setEventClock(fd);
+            }
+            break;
+        }
+        closedir(inputDir);
+    }
+    closedir(dir);
+    ALOGE_IF(fd<0, "SensorBase couldn't find '%s' input device in %s", inputName, sysfsDir);
+    return fd;
+}
+
+/*
+ * Same as the index, but without its size limit and opening the first match.
+ * Only used when the index does not know inputName.
+ */
+int SensorBase::scanInput(const char* inputName) {
+    const char *dirname = "/sys/class/input";
+    char path[PATH_MAX];
+    char name[80];
     DIR *dir;
     struct dirent *de;
+    int fd = -1;
+
     dir = opendir(dirname);
-    if(dir == NULL)
+    if (dir == NULL) {
         return -1;
-    strcpy(devname, dirname);
-    filename = devname + strlen(devname);
-    *filename++ = '/';
-    while((de = readdir(dir))) {
-        if(de->d_name[0] == '.' &&
-                (de->d_name[1] == '\0' ||
-                        (de->d_name[1] == '.' && de->d_name[2] == '\0')))
+    }
+    while (fd < 0 && (de = readdir(dir))) {
+        if (strncmp(de->d_name, "event", 5))
             continue;
-        strcpy(filename, de->d_name);
-        fd = open(devname, O_RDONLY);
-        if (fd>=0) {
+        snprintf(path, sizeof(path), "%s/%s/device/name", dirname, de->d_name);
+        if (read_sys_attribute(path, name, sizeof(name)) <= 0)
+            continue;
+        name[strcspn(name, "\n")] = '\0';
+        if (strcmp(name, inputName))
+            continue;
+        snprintf(path, sizeof(path), "/dev/input/%s", de->d_name);
+        fd = open(path, O_RDONLY | O_NONBLOCK);
+        if (fd >= 0) {
+            strncpy(input_name, de->d_name, sizeof(input_name) - 1);
+            input_name[sizeof(input_name) - 1] = '\0';
+            setEventClock(fd);
+        }
+    }
+    closedir(dir);
+    return fd;
+}
+
+int SensorBase::openInput(const char* inputName) {
+    int fd = -1;
+    char devname[PATH_MAX];
+
+    if (data_dir) {
+        return openInputIn(data_dir, inputName);
+    }
+
+    pthread_mutex_lock(&sInputIndexLock);
+    const char *node = lookupInputNode(inputName);
+    if (node) {
+        snprintf(devname, sizeof(devname), "/dev/input/%s", node);
+        // non-blocking, the poll loop only reads after POLLIN anyway
+        fd = open(devname, O_RDONLY | O_NONBLOCK);
+        if (fd >= 0) {
+            // the index may be stale, make sure it is still the right device
             char name[80];
             if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
                 name[0] = '\0';
             }
             if (!strcmp(name, inputName)) {
-                strcpy(input_name, filename);
-                break;
+                strcpy(input_name, node);
+                setEventClock(fd);
             } else {
                 close(fd);
                 fd = -1;
+                sInputIndexValid = false;
             }
         }
     }
-    closedir(dir);
+    pthread_mutex_unlock(&sInputIndexLock);
+    if (fd < 0) {
+        // the index may be truncated or stale
+        fd = scanInput(inputName);
+    }
     ALOGE_IF(fd<0, "SensorBase couldn't find '%s' input device", inputName);
     return fd;
 }
-
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
+#include <pthread.h>
 
 
 /*****************************************************************************/
@@ -28,15 +29,35 @@
 struct sensors_event_t;
 
 class SensorBase {
+    /* name -> event node index built from /sys/class/input, shared by all sensors */
+    struct InputIndexEntry {
+        char name[80];
+        char node[16];
+    };
+    enum { MAX_INPUT_DEVICES = 32 };
+    static InputIndexEntry sInputIndex[MAX_INPUT_DEVICES];
+    static int sInputIndexCount;
+    static bool sInputIndexValid;
+    static pthread_mutex_t sInputIndexLock;
+
+    static void buildInputIndex();
+    static const char* lookupInputNode(const char* inputName);
+    int scanInput(const char* inputName);
+
 protected:
     const char* dev_name;
     const char* data_name;
+    const char* data_dir;   // sysfs dir of the parent device, NULL to match by name only
     char        input_name[PATH_MAX];
     int         dev_fd;
     int         data_fd;
+    clockid_t   data_clock;     // clock of the input event timestamps
 
     int openInput(const char* inputName);
+    int openInputIn(const char* sysfsDir, const char* inputName);
     static int64_t getTimestamp();
+    int64_t eventTimestamp(timeval const& t) const;
+    void setEventClock(int fd);
 
 
     static int64_t timevalToNano(timeval const& t) {
@@ -48,11 +69,15 @@ protected:
 	int write_int(char const *path, int value);
 	int write_sys_attribute(
 		char const *path, char const *value, int bytes);
+	static int read_sys_attribute(
+		char const *path, char *value, int bytes);
+	static int read_int(char const *path, int *value);
 
 public:
             SensorBase(
                     const char* dev_name,
-                    const char* data_name);
+                    const char* data_name,
+                    const char* data_dir = NULL);
 
     virtual ~SensorBase();
 
@@ -60,6 +85,13 @@ public:
     virtual bool hasPendingEvents() const;
     virtual int getFd() const;
 
+    /* Called when /dev/input changed. Reopens the input device if it is gone
+       or was not found yet, returns true if the fd changed. */
+    virtual bool handleHotplug();
+
+    /* Forget the input device index, e.g. after hotplug. Rebuilt on next use. */
+    static void invalidateInputIndex();
+
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int64_t getDelay(int32_t handle);
 
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <cutils/atomic.h>
+
+#include "SensorEventRing.h"
+
+/*****************************************************************************/
+
+static uint32_t roundUpPow2(size_t n) {
+    uint32_t size = 1;
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+
+SensorEventRing::SensorEventRing(size_t numEvents)
+    : mBuffer(new sensors_event_t[roundUpPow2(numEvents)]),
+      mSize(roundUpPow2(numEvents)),
+      mHead(0),
+      mTail(0)
+{
+}
+
+SensorEventRing::~SensorEventRing()
+{
+    delete [] mBuffer;
+}
+
+size_t SensorEventRing::space() const
+{
+    uint32_t used = uint32_t(mHead - android_atomic_acquire_load(&mTail));
+    return mSize - used;
+}
+
+size_t SensorEventRing::available() const
+{
+    return uint32_t(android_atomic_acquire_load(&mHead) - mTail);
+}
+
+size_t SensorEventRing::write(sensors_event_t const* events, size_t count)
+{
+    const int32_t head = mHead;
+    size_t n = space();
+    if (count < n) {
+        n = count;
+    }
+    for (size_t i = 0; i < n; i++) {
+        mBuffer[(head + i) & (mSize - 1)] = events[i];
+    }
+    // publish the events only after they are written
+    android_atomic_release_store(head + n, &mHead);
+    return n;
+}
+
+size_t SensorEventRing::read(sensors_event_t* events, size_t count)
+{
+    const int32_t tail = mTail;
+    size_t n = available();
+    if (count < n) {
+        n = count;
+    }
+    for (size_t i = 0; i < n; i++) {
+        events[i] = mBuffer[(tail + i) & (mSize - 1)];
+    }
+    // hand the slots back only after they are copied out
+    android_atomic_release_store(tail + n, &mTail);
+    return n;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_EVENT_RING_H
+#define ANDROID_SENSOR_EVENT_RING_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+
+/*****************************************************************************/
+
+/*
+ * Lock-free ring of sensors_event_t for exactly one producer and one consumer
+ * thread. Head is only written by the producer, tail only by the consumer.
+ */
+class SensorEventRing
+{
+    sensors_event_t* const mBuffer;
+    const uint32_t mSize;       // power of two
+    volatile int32_t mHead;     // free running, producer
+    volatile int32_t mTail;     // free running, consumer
+
+public:
+    SensorEventRing(size_t numEvents);
+    ~SensorEventRing();
+
+    /* producer side, returns the number of events stored */
+    size_t write(sensors_event_t const* events, size_t count);
+    size_t space() const;
+
+    /* consumer side, returns the number of events copied */
+    size_t read(sensors_event_t* events, size_t count);
+    size_t available() const;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_EVENT_RING_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_REGISTRY_H
+#define ANDROID_SENSOR_REGISTRY_H
+
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+
+#include "SensorBase.h"
+
+/*****************************************************************************/
+
+/*
+ * Compile time list of the driver kinds a HAL build knows. A kind is a struct
+ * with
+ *
+ *   typedef ... Driver;        the SensorBase subclass
+ *   enum { MAX_DRIVERS, MAX_SENSORS };
+ *   static int listSensors(struct sensor_t* list);
+ *
+ * and a specialization of Ctx::attach<Kind>() that registers its drivers.
+ * Kinds are chained with SensorKindList<Kind, Next> and end in
+ * SensorKindListEnd. The order of the list is the order of the sensor list.
+ *
+ * Drivers are probed at runtime, the number of srf02s is not known before,
+ * but table sizes, kind indices and the event dispatch come from the list.
+ */
+template <class Kind, class Next>
+struct SensorKindList {
+    typedef Kind Head;
+    typedef Next Tail;
+};
+
+struct SensorKindListEnd {
+};
+
+template <class List>
+struct SensorRegistry {
+    typedef typename List::Head Head;
+    typedef SensorRegistry<typename List::Tail> Tail;
+
+    enum {
+        NUM_KINDS = 1 + Tail::NUM_KINDS,
+        MAX_DRIVERS = Head::MAX_DRIVERS + Tail::MAX_DRIVERS,
+        MAX_SENSORS = Head::MAX_SENSORS + Tail::MAX_SENSORS,
+    };
+
+    /* Fills list with the sensors of every kind, returns their number. */
+    static int listSensors(struct sensor_t* list) {
+        int n = Head::listSensors(list);
+        return n + Tail::listSensors(list + n);
+    }
+
+    template <class Ctx>
+    static void attach(Ctx* ctx) {
+        ctx->template attach<Head>();
+        Tail::attach(ctx);
+    }
+
+    /*
+     * The driver of kind is known to be a Head::Driver (or one of the
+     * following kinds), so the qualified calls below bypass the vtable and
+     * can be inlined into the poll loop.
+     */
+    static int readEvents(int kind, SensorBase* sensor,
+            sensors_event_t* data, int count) {
+        if (kind == 0) {
+            typedef typename Head::Driver Driver;
+            return static_cast<Driver*>(sensor)->Driver::readEvents(data, count);
+        }
+        return Tail::readEvents(kind - 1, sensor, data, count);
+    }
+
+    static bool hasPendingEvents(int kind, const SensorBase* sensor) {
+        if (kind == 0) {
+            typedef typename Head::Driver Driver;
+            return static_cast<const Driver*>(sensor)->Driver::hasPendingEvents();
+        }
+        return Tail::hasPendingEvents(kind - 1, sensor);
+    }
+};
+
+template <>
+struct SensorRegistry<SensorKindListEnd> {
+    enum {
+        NUM_KINDS = 0,
+        MAX_DRIVERS = 0,
+        MAX_SENSORS = 0,
+    };
+
+    static int listSensors(struct sensor_t*) {
+        return 0;
+    }
+
+    template <class Ctx>
+    static void attach(Ctx*) {
+    }
+
+    /* unknown kinds fall back to the vtable */
+    static int readEvents(int, SensorBase* sensor, sensors_event_t* data, int count) {
+        return sensor->readEvents(data, count);
+    }
+
+    static bool hasPendingEvents(int, const SensorBase* sensor) {
+        return sensor->hasPendingEvents();
+    }
+};
+
+/* Index of Kind in List, a compile error if it is not part of it. */
+template <class List, class Kind>
+struct SensorKindIndex {
+    enum { value = 1 + SensorKindIndex<typename List::Tail, Kind>::value };
+};
+
+template <class Kind, class Next>
+struct SensorKindIndex<SensorKindList<Kind, Next>, Kind> {
+    enum { value = 0 };
+};
+
+/* True if First is listed before Second, for kinds that build on the entries of others. */
+template <class List, class First, class Second>
+struct SensorKindBefore {
+    enum {
+        value = (int)SensorKindIndex<List, First>::value
+                < (int)SensorKindIndex<List, Second>::value
+    };
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_REGISTRY_H
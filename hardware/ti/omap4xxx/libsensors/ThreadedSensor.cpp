@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <cutils/log.h>
+
+#include "ThreadedSensor.h"
+
+/*****************************************************************************/
+
+ThreadedSensor::ThreadedSensor(SensorBase* sensor, size_t ringEvents)
+    : SensorBase(NULL, NULL),
+      mSensor(sensor),
+      mRing(ringEvents),
+      mThreadRunning(false)
+{
+    pthread_mutex_init(&mSensorLock, NULL);
+    mNotifyFds[0] = mNotifyFds[1] = -1;
+    mControlFds[0] = mControlFds[1] = -1;
+
+    if (pipe(mNotifyFds) < 0 || pipe(mControlFds) < 0) {
+        ALOGE("ThreadedSensor: error creating pipes (%s)", strerror(errno));
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(mNotifyFds[i], F_SETFL, O_NONBLOCK);
+        fcntl(mControlFds[i], F_SETFL, O_NONBLOCK);
+    }
+
+    int err = pthread_create(&mThread, NULL, threadLoop, this);
+    ALOGE_IF(err, "ThreadedSensor: error creating reader thread (%s)", strerror(err));
+    mThreadRunning = !err;
+}
+
+SensorBase* ThreadedSensor::wrap(SensorBase* sensor, size_t ringEvents) {
+    ThreadedSensor* threaded = new ThreadedSensor(sensor, ringEvents);
+    if (threaded->mThreadRunning) {
+        return threaded;
+    }
+    ALOGE("ThreadedSensor: reading on the engine thread instead");
+    threaded->mSensor = NULL;
+    delete threaded;
+    return sensor;
+}
+
+ThreadedSensor::~ThreadedSensor() {
+    if (mThreadRunning) {
+        control(CONTROL_QUIT);
+        pthread_join(mThread, NULL);
+    }
+    delete mSensor;
+    pthread_mutex_destroy(&mSensorLock);
+    for (int i = 0; i < 2; i++) {
+        if (mNotifyFds[i] >= 0) {
+            close(mNotifyFds[i]);
+        }
+        if (mControlFds[i] >= 0) {
+            close(mControlFds[i]);
+        }
+    }
+}
+
+void ThreadedSensor::control(char msg) {
+    if (write(mControlFds[1], &msg, 1) < 0) {
+        ALOGE("ThreadedSensor: error writing control pipe (%s)", strerror(errno));
+    }
+}
+
+void* ThreadedSensor::threadLoop(void* arg) {
+    static_cast<ThreadedSensor*>(arg)->run();
+    return NULL;
+}
+
+/*
+ * Binder threads still call setEnable/getEnable/setDelay of the wrapped driver,
+ * so every call into it holds mSensorLock. poll() itself runs without it.
+ */
+void ThreadedSensor::run() {
+    sensors_event_t buffer[BATCH_EVENTS];
+    bool more = false;
+    // hasPendingEvents() alone may stay true without readEvents() returning anything,
+    // e.g. after an unplug, only retry right away while the reads make progress
+    bool progress = true;
+
+    if (setpriority(PRIO_PROCESS, gettid(), THREAD_PRIORITY) < 0) {
+        ALOGW("ThreadedSensor: couldn't raise reader thread priority (%s)", strerror(errno));
+    }
+
+    for (;;) {
+        struct pollfd fds[2];
+        bool full = mRing.space() == 0;
+        int timeout = -1;
+
+        fds[0].fd = mControlFds[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        // a full ring leaves the events in the kernel until the consumer catches up
+        pthread_mutex_lock(&mSensorLock);
+        fds[1].fd = full ? -1 : mSensor->getFd();
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        if (full) {
+            timeout = RING_FULL_RETRY_MS;
+        } else if (more || (progress && mSensor->hasPendingEvents())) {
+            timeout = 0;
+        }
+        pthread_mutex_unlock(&mSensorLock);
+
+        int n = poll(fds, 2, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("ThreadedSensor: poll failed (%s)", strerror(errno));
+            return;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char msg[16];
+            ssize_t nr;
+            while ((nr = read(mControlFds[0], msg, sizeof(msg))) > 0) {
+                for (ssize_t i = 0; i < nr; i++) {
+                    if (msg[i] == CONTROL_QUIT) {
+                        return;
+                    }
+                    if (msg[i] == CONTROL_HOTPLUG) {
+                        pthread_mutex_lock(&mSensorLock);
+                        mSensor->handleHotplug();
+                        pthread_mutex_unlock(&mSensorLock);
+                    }
+                    // CONTROL_ENABLE only wakes us up to pick up the initial event
+                    progress = true;
+                }
+            }
+        }
+        if (full) {
+            continue;
+        }
+
+        pthread_mutex_lock(&mSensorLock);
+        int nb = 0;
+        size_t space = 0;
+        if (fds[1].revents || mSensor->hasPendingEvents()) {
+            space = mRing.space();
+            if (space > BATCH_EVENTS) {
+                space = BATCH_EVENTS;
+            }
+            nb = mSensor->readEvents(buffer, space);
+            progress = nb > 0;
+        }
+        pthread_mutex_unlock(&mSensorLock);
+        if (nb > 0) {
+            mRing.write(buffer, nb);
+            char c = 0;
+            // EAGAIN means the pipe is readable anyway
+            write(mNotifyFds[1], &c, 1);
+        }
+        // the driver may have more buffered than fitted
+        more = space && nb == int(space);
+    }
+}
+
+int ThreadedSensor::readEvents(sensors_event_t* data, int count) {
+    char buf[64];
+
+    // drain first, events pushed afterwards write a new notification
+    while (read(mNotifyFds[0], buf, sizeof(buf)) > 0) {
+    }
+    return mRing.read(data, count);
+}
+
+bool ThreadedSensor::hasPendingEvents() const {
+    return mRing.available() != 0;
+}
+
+int ThreadedSensor::getFd() const {
+    return mNotifyFds[0];
+}
+
+bool ThreadedSensor::handleHotplug() {
+    // the device is reopened on the reader thread, our fd stays the same
+    control(CONTROL_HOTPLUG);
+    return false;
+}
+
+int ThreadedSensor::setDelay(int32_t handle, int64_t ns) {
+    pthread_mutex_lock(&mSensorLock);
+    int err = mSensor->setDelay(handle, ns);
+    pthread_mutex_unlock(&mSensorLock);
+    return err;
+}
+
+int64_t ThreadedSensor::getDelay(int32_t handle) {
+    pthread_mutex_lock(&mSensorLock);
+    int64_t ns = mSensor->getDelay(handle);
+    pthread_mutex_unlock(&mSensorLock);
+    return ns;
+}
+
+int ThreadedSensor::setEnable(int32_t handle, int enabled) {
+    pthread_mutex_lock(&mSensorLock);
+    int err = mSensor->setEnable(handle, enabled);
+    pthread_mutex_unlock(&mSensorLock);
+    control(CONTROL_ENABLE);
+    return err;
+}
+
+int ThreadedSensor::getEnable(int32_t handle) {
+    pthread_mutex_lock(&mSensorLock);
+    int count = mSensor->getEnable(handle);
+    pthread_mutex_unlock(&mSensorLock);
+    return count;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_THREADED_SENSOR_H
+#define ANDROID_THREADED_SENSOR_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "SensorBase.h"
+#include "SensorEventRing.h"
+
+/*****************************************************************************/
+
+/*
+ * Runs the readEvents() of another driver on a high priority thread and
+ * queues the events in a SensorEventRing. Bursts are absorbed here instead of
+ * overflowing the evdev buffer while sensorservice is busy. getFd() becomes
+ * readable whenever the ring has events.
+ */
+class ThreadedSensor : public SensorBase {
+    enum {
+        BATCH_EVENTS = 32,          // events moved per readEvents() of the driver
+        RING_FULL_RETRY_MS = 10,
+        THREAD_PRIORITY = -8,       // ANDROID_PRIORITY_URGENT_DISPLAY
+    };
+    enum {
+        CONTROL_QUIT = 'Q',
+        CONTROL_HOTPLUG = 'H',
+        CONTROL_ENABLE = 'E',
+    };
+
+    SensorBase* mSensor;
+    // every call into mSensor holds it, drivers are not thread safe themselves
+    mutable pthread_mutex_t mSensorLock;
+    SensorEventRing mRing;
+    pthread_t mThread;
+    bool mThreadRunning;
+    int mNotifyFds[2];      // reader thread -> engine thread
+    int mControlFds[2];     // poll and binder threads -> reader thread
+
+    static void* threadLoop(void* arg);
+    void run();
+    void control(char msg);
+
+            ThreadedSensor(SensorBase* sensor, size_t ringEvents);
+
+public:
+    virtual ~ThreadedSensor();
+
+    /* Returns the wrapped driver, or the driver itself if no thread could be
+       started. Takes ownership of sensor either way. */
+    static SensorBase* wrap(SensorBase* sensor, size_t ringEvents);
+
+    virtual int readEvents(sensors_event_t* data, int count);
+    virtual bool hasPendingEvents() const;
+    virtual int getFd() const;
+    virtual bool handleHotplug();
+
+    virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int64_t getDelay(int32_t handle);
+    virtual int setEnable(int32_t handle, int enabled);
+    virtual int getEnable(int32_t handle);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_THREADED_SENSOR_H
@@ -22,35 +22,105 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/select.h>
+#include <sys/ioctl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "proximity_sensor.h"
 
+// thresholds of the near/far output in cm, far is near + hysteresis
+#define NEAR_PROPERTY	"ro.sensors.srf02.near_cm"
+#define NEAR_DEFAULT_CM	"30"
+#define HYSTERESIS_PROPERTY	"ro.sensors.srf02.hysteresis_cm"
+#define HYSTERESIS_DEFAULT_CM	"10"
+// set to 1 to report the distance extrapolated to the time of delivery, see newSample()
+#define PREDICT_PROPERTY	"ro.sensors.srf02.predict"
+#define PREDICT_ALPHA	(0.5f)
+#define PREDICT_BETA	(0.2f)
+
 
 /*
 * Constructor for Proximity Sensor HAL driver. Calling Constructor of super class SensorBase to get an InputEventReader
 * for reading values from input event subsystem in the kernel driver. 
+* sysfsDir has to stay valid for the lifetime of the sensor, the input device is looked up below it.
+* handle is the wake-up variant, the non-wake-up one is NON_WAKE_UP_HANDLE(handle) and the
+* near/far output NEAR_FAR_HANDLE(handle).
 */
-ProximitySensor::ProximitySensor ()
-	: SensorBase (NULL, "SRF02 input event module"), //second param for getting input events from kernel driver
+ProximitySensor::ProximitySensor (const char *sysfsDir, int handle)
+	: SensorBase (NULL, SRF02_INPUT_NAME, sysfsDir), //second param for getting input events from kernel driver
+	  	mSysfsDir (sysfsDir),
 	  	mEnabled (0),
-	  	mInputReader((size_t)(4)),
-	  	mHasPendingEvent(true)
+	  	mInputReader((size_t)(INPUT_EVENTS)),
+	  	mSampleInvalid(false),
+	  	mDropping(false),
+	  	mScale(1.0f),
+	  	mEstimator(PREDICT_ALPHA, PREDICT_BETA),
+	  	mSampleLatencyNs(0)
 	 {
 
+	initOutputs (handle);
+	readSampleLatency();
+	readUnit();
+
+	// the kernel driver stays idle until the first activate(), see setEnable()
+	mValueNowFd = openControl ("value_now");
+	mPeriodFd = openControl ("period");
+}
+
+ProximitySensor::ProximitySensor (int handle)
+	: SensorBase (NULL, NULL),
+	  	mSysfsDir (NULL),
+	  	mEnabled (0),
+	  	mValueNowFd (-1),
+	  	mPeriodFd (-1),
+	  	mInputReader((size_t)(1)),
+	  	mSampleInvalid(false),
+	  	mDropping(false),
+	  	mScale(1.0f),
+	  	mEstimator(PREDICT_ALPHA, PREDICT_BETA),
+	  	mSampleLatencyNs(0)
+	 {
+
+	initOutputs (handle);
+}
+
+/*
+* Handles, thresholds and the pending event, the same for every backend.
+*/
+void ProximitySensor::initOutputs (int handle) {
 	// mPendingEvent -> sensors_event_t -> struct for store data about the sensor
 	// sensor value is stored in mPendingEvent.distance
 
-	mPendingEvent.sensor = ID_PX;
+	for (int v = 0; v < NUM_OUTPUTS; v++) {
+		mActive[v] = false;
+		mInitialPending[v] = false;
+		mLastValue[v] = -1;
+	}
+	mHandles[WAKE_UP] = handle;
+	if (SENSOR_VARIANTS > 1) {
+		mHandles[NON_WAKE_UP] = NON_WAKE_UP_HANDLE(handle);
+	}
+	mHandles[NEAR_FAR] = NEAR_FAR_HANDLE(handle);
+	mHandles[FUSION_SOURCE] = FUSION_SOURCE_HANDLE(handle);
+
+	char value [PROPERTY_VALUE_MAX];
+	property_get (NEAR_PROPERTY, value, NEAR_DEFAULT_CM);
+	mNearCm = atof (value);
+	property_get (HYSTERESIS_PROPERTY, value, HYSTERESIS_DEFAULT_CM);
+	mFarCm = mNearCm + atof (value);
+	mNear = false;
+	property_get (PREDICT_PROPERTY, value, "0");
+	mPredict = atoi (value) != 0;
+
+	memset(&mPendingEvent, 0, sizeof(mPendingEvent));
+	mPendingEvent.version = sizeof(sensors_event_t);
+	mPendingEvent.sensor = handle;
 	mPendingEvent.type = SENSOR_TYPE_PROXIMITY;
 	mPendingEvent.distance = 5;
-	memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
-
-	// Enabling driver in kernel
-	enable(0, 1);
 }
 
 /*
@@ -58,71 +128,270 @@ ProximitySensor::ProximitySensor ()
 */
 ProximitySensor::~ProximitySensor () {
 	enable(0, 0);
+	if (mValueNowFd >= 0) {
+		close (mValueNowFd);
+	}
+	if (mPeriodFd >= 0) {
+		close (mPeriodFd);
+	}
 }
 
 /*
-* Set initial State.
+* The echo is taken about half way through the ranging, the kernel reports at its end.
+* The ranging time follows max_range_mm, which may change at runtime.
+*/
+void ProximitySensor::readSampleLatency () {
+	char path [PATH_MAX];
+	int rangingUs;
+
+	if (!mSysfsDir) {
+		return;
+	}
+	snprintf (path, sizeof(path), "%sranging_time_us", mSysfsDir);
+	if (read_int (path, &rangingUs) == 0) {
+		mSampleLatencyNs = rangingUs * 1000LL / 2;
+	}
+}
+
+/*
+* The board file may configure the kernel driver to report inches or echo time,
+* Android wants cm.
+*/
+void ProximitySensor::readUnit () {
+	char sysfs [PATH_MAX];
+	char unit [16];
+
+	snprintf (sysfs, sizeof(sysfs), "%sunit", mSysfsDir);
+
+	if (read_sys_attribute (sysfs, unit, sizeof(unit)) <= 0) {
+		return;
+	}
+	if (!strncmp (unit, "inch", 4)) {
+		mScale = 2.54f;
+	}
+	else if (!strncmp (unit, "us", 2)) {
+		// echo time covers the distance twice, speed of sound 0.0343 cm/us
+		mScale = 0.0343f / 2;
+	}
+}
+
+/*
+* Set initial State. The initial event of every activated variant carries this value,
+* so the framework gets a value right after activation, before the first real measurement arrives.
 */
 int ProximitySensor::setInitialState () {
-	mHasPendingEvent = true;
 	mPendingEvent.distance = 5; // as a start value
+	// the start value is no measurement, near/far starts as far
+	mNear = false;
+	mEstimator.reset();
+	readSampleLatency();
 
 	return 0;
 }
 
+int ProximitySensor::outputOf (int32_t handle) const {
+	for (int v = 0; v < NUM_OUTPUTS; v++) {
+		if (mHandles[v] == handle) {
+			return v;
+		}
+	}
+	return -EINVAL;
+}
+
+int ProximitySensor::activeOutputs () const {
+	int active = 0;
+
+	for (int v = 0; v < NUM_OUTPUTS; v++) {
+		if (mActive[v]) {
+			active++;
+		}
+	}
+	return active;
+}
+
 /*
-* Enabling or disabling kernel driver for Proximity Sensor.
+* Near/far state of mPendingEvent.distance. Between the two thresholds the state
+* is kept, so noise around one threshold does not toggle it.
 */
-int ProximitySensor::enable (int32_t handle, int en) {
-	 int newState = en ? 1 : 0;
-	 int err = 0;
+void ProximitySensor::updateNearFar () {
+	if (mNear && mPendingEvent.distance > mFarCm) {
+		mNear = false;
+	}
+	else if (!mNear && mPendingEvent.distance < mNearCm) {
+		mNear = true;
+	}
+}
 
-	 if (newState != mEnabled) {
-		 if (!mEnabled && dev_name != NULL) {
-			 open_device();
-		 }
+/*
+* A valid sample is in mPendingEvent.distance, time is the timestamp of its SYN_REPORT.
+*/
+void ProximitySensor::newSample (int64_t time) {
+	updateNearFar();
+	mEstimator.update(time - mSampleLatencyNs, mPendingEvent.distance);
+}
 
-		 char sysfs [PATH_MAX];
+/*
+* Copy mPendingEvent to every activated output. Proximity is an on-change sensor,
+* so an output only gets it if its value changed or its initial event is due. For
+* the near/far output that means transitions only. The fusion source gets every measured
+* sample and nothing else, the start value of an initial event is no obstacle.
+* With prediction the distance outputs carry the estimate for the time of delivery:
+* data[0] distance in cm, data[1] closing speed in cm/s, data[2] one sigma of data[0].
+*/
+int ProximitySensor::report (sensors_event_t* data, int count, int64_t timestamp, bool measured) {
+	bool predict = mPredict && mEstimator.isValid();
+	int64_t now = predict ? getTimestamp() : 0;
+	int n = 0;
 
-		 strcpy (sysfs, I2C);
-		 strcat (sysfs, "value_now");
+	for (int v = 0; v < NUM_OUTPUTS && n < count; v++) {
+		float value = mPendingEvent.distance;
+		bool raw = v != NEAR_FAR && v != FUSION_SOURCE;
 
-		 ALOGI_IF (DEBUG, "proximitysensor enable.open(%s), en (%d)", sysfs, en);
+		if (!mActive[v] || (v == FUSION_SOURCE && !measured)) {
+			continue;
+		}
+		if (v == NEAR_FAR) {
+			value = mNear ? NEAR_FAR_NEAR : NEAR_FAR_FAR;
+		}
+		else if (raw && predict) {
+			value = mEstimator.position(now);
+		}
+		if (v != FUSION_SOURCE && !mInitialPending[v] && mLastValue[v] == value) {
+			continue;
+		}
+		mInitialPending[v] = false;
+		mLastValue[v] = value;
+		data[n] = mPendingEvent;
+		data[n].sensor = mHandles[v];
+		data[n].distance = value;
+		data[n].timestamp = timestamp;
+		if (raw && predict) {
+			data[n].data[1] = -mEstimator.velocity();
+			data[n].data[2] = mEstimator.uncertainty(now);
+			data[n].timestamp = now;
+		}
+		n++;
+	}
+	return n;
+}
 
-		 int fd = open (sysfs, O_RDWR);
+/*
+* A failed measurement only goes to the fusion source, the nearest obstacle sensor stops
+* counting this srf02 until it measures again. The other outputs keep their last value.
+*/
+int ProximitySensor::reportFailure (sensors_event_t* data, int count, int64_t timestamp) {
+	if (!mActive[FUSION_SOURCE] || count < 1) {
+		return 0;
+	}
+	*data = mPendingEvent;
+	data->sensor = mHandles[FUSION_SOURCE];
+	data->distance = FUSION_SOURCE_FAILED;
+	data->timestamp = timestamp;
+	return 1;
+}
 
-		 if (fd < 0) {
-			 ALOGE ("proximitysensor couldn't open '%s' input device", sysfs);
-			 err = -1;
-		 }
-		 else {
-			 //sensor enabling in sysfs
-			 char buf [2];
+/*
+* With a wake-up output active, events queued in evdev keep the system awake until
+* they are read. Only Android kernels have this ioctl.
+*/
+void ProximitySensor::updateSuspendBlock () {
+#ifdef EVIOCSSUSPENDBLOCK
+	int wakeUp = mActive[WAKE_UP] || mActive[NEAR_FAR];
 
-			 buf [0] = newState ? '1' : '0';
-			 buf [1] = '\0';
+	if (data_fd >= 0 && ioctl (data_fd, EVIOCSSUSPENDBLOCK, wakeUp) < 0) {
+		ALOGE ("ProximitySensor: EVIOCSSUSPENDBLOCK failed (%s)", strerror(errno));
+	}
+#endif
+}
 
-			 write (fd, buf, sizeof(buf));
-			 close (fd);
-			 setInitialState();
+/*
+* Fetch the current distance from the input device after evdev dropped events,
+* whatever arrived before the drop can not be trusted.
+*/
+int ProximitySensor::resync () {
+	struct input_absinfo absinfo;
+
+	if (ioctl (data_fd, EVIOCGABS(ABS_DISTANCE), &absinfo) < 0) {
+		ALOGE ("ProximitySensor: EVIOCGABS failed (%s)", strerror(errno));
+		return -errno;
+	}
+	mPendingEvent.distance = absinfo.value * mScale;
+	return 0;
+}
+
+/*
+* Open a control attribute of the kernel driver once, it is written with pwrite() later.
+*/
+int ProximitySensor::openControl (const char *attr) {
+	char sysfs [PATH_MAX];
+
+	snprintf (sysfs, sizeof(sysfs), "%s%s", mSysfsDir, attr);
+	int fd = open (sysfs, O_WRONLY | O_CLOEXEC);
+	ALOGE_IF (fd < 0, "proximitysensor couldn't open '%s' (%s)", sysfs, strerror(errno));
+	return fd;
+}
 
-			// ALOGE("srf02 - enable sensor in sysfs \n ");
+/*
+* Write a decimal value to a control attribute. sysfs handles every write at offset 0
+* as a new store, so the fd never needs to be reopened or seeked.
+*/
+int ProximitySensor::writeControl (int fd, long value) {
+	char buf [16];
+
+	if (fd < 0) {
+		return -ENODEV;
+	}
+	int len = snprintf (buf, sizeof(buf), "%ld\n", value);
+	if (pwrite (fd, buf, len, 0) < 0) {
+		return -errno;
+	}
+	return 0;
+}
+
+/*
+* Enabling or disabling kernel driver for Proximity Sensor. Only called for the
+* first and the last reference, see setEnable().
+*/
+int ProximitySensor::enable (int32_t handle, int en) {
+	 int newState = en ? 1 : 0;
+	 int err = 0;
+
+	 if (newState != mEnabled) {
+		 ALOGI_IF (DEBUG, "proximitysensor enable(%d)", en);
+
+		 err = writeControl (mValueNowFd, newState);
+		 if (err < 0) {
+			 ALOGE ("proximitysensor couldn't write value_now (%s)", strerror(-err));
+			 return err;
+		 }
+		 if (newState) {
+			 setInitialState();
 		 }
 	 }
 	 mEnabled = newState;
-	 mHasPendingEvent = true;
-
-	 if (!mEnabled && dev_name != NULL) {
-		 close_device();
-	 }
 	 return err;
 }
 
 /*
-* Return mHasPendingEvent.
+* Synthetic initial events, they are not signalled by the input device.
+*/
+bool ProximitySensor::initialEventsPending () const {
+	for (int v = 0; v < NUM_OUTPUTS; v++) {
+		if (mActive[v] && mInitialPending[v]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+* Real samples are signalled by POLLIN on the input device, except those already read
+* from it that did not fit into data on the last readEvents().
 */
 bool ProximitySensor::hasPendingEvents () const {
-	return mHasPendingEvent;
+	input_event const* events;
+
+	return initialEventsPending() || mInputReader.peek(&events) > 0;
 }
 
 /*
@@ -132,55 +401,197 @@ int ProximitySensor::readEvents (sensors_event_t* data, int count) {
 	if (count < 1) {
 		return -EINVAL;
 	}
-	if (mHasPendingEvent) {
-		mHasPendingEvent = false;
-		mPendingEvent.timestamp = getTimestamp();
-		*data = mPendingEvent;
-		return mEnabled ? 1 : 0;
+	if (initialEventsPending()) {
+		return report(data, count, getTimestamp(), false);
 	}
 
-	// data_fd technically set in super class constructor but value got overwritten
-	// so data_fd is set new
-	data_fd = openInput("SRF02 input event module");
+	// data_fd is resolved once in the constructor of SensorBase and only
+	// reopened by handleHotplug()
+	if (data_fd < 0) {
+		return 0;
+	}
 
 	ssize_t n = mInputReader.fill(data_fd);
-	if (n < 0) {
+	if (n == -ENODEV) {
+		// device is gone, stop polling it until it comes back
+		ALOGE ("ProximitySensor: input device removed");
+		close (data_fd);
+		data_fd = -1;
+		// nothing is read until it comes back, leftovers must not keep hasPendingEvents() true
+		input_event const* stale;
+		size_t left;
+		while ((left = mInputReader.peek(&stale))) {
+			mInputReader.consume(left);
+		}
+		// no more samples, the last one must not stay the nearest obstacle
+		return reportFailure(data, count, getTimestamp());
+	}
+	if (n < 0 && n != -EAGAIN) {
 		return n;
 	}
+	// on -EAGAIN there may still be events left in the reader from the last call
 
 	int numEventRecieved = 0;
-	input_event const* event;
-
-	while (count && mInputReader.readEvent(&event)) {
-		// evaluating event type set in kernel driver
-		int type = event->type;
-		// ALOGD("sensor in ProximitySensor readEvents() - event->type is: %d", type);
-		if (type == EV_ABS) {
-			if (event->code == ABS_DISTANCE) {
-				// ALOGD("sensor in ProximitySensor readEvents() in if event->code == ABS_DISTANCE -> input event kernel");
-				mPendingEvent.sensor = ID_PX;
-				mPendingEvent.type = SENSOR_TYPE_PROXIMITY;
-				mPendingEvent.distance = (float) event->value;
-				// ALOGD("sensor srf02 - value is : %d	\n ", event->value);
+	input_event const* events;
+	size_t available;
+	// one sample may become an event for every active output
+	int needed = activeOutputs();
+	if (needed < 1) {
+		needed = 1;
+	}
+
+	// translate the reader span by span straight into data
+	while (count >= needed && (available = mInputReader.peek(&events))) {
+		size_t used;
+
+		for (used = 0; count >= needed && used < available; used++) {
+			input_event const* event = &events[used];
+			// evaluating event type set in kernel driver
+			int type = event->type;
+			// ALOGD("sensor in ProximitySensor readEvents() - event->type is: %d", type);
+			if (type == EV_SYN && event->code == SYN_DROPPED) {
+				// the client buffer overflowed, drop everything up to the next SYN_REPORT
+				ALOGW ("ProximitySensor: input events dropped, resyncing");
+				mDropping = true;
+				mSampleInvalid = false;
+			}
+			else if (mDropping) {
+				if (type == EV_SYN && event->code == SYN_REPORT) {
+					mDropping = false;
+					if (!resync()) {
+						// whatever was lost, the old trend does not fit anymore
+						mEstimator.reset();
+						newSample(eventTimestamp(event->time));
+						int nb = report(data, count, eventTimestamp(event->time), true);
+						data += nb;
+						count -= nb;
+						numEventRecieved += nb;
+					}
+				}
+			}
+			else if (type == EV_ABS) {
+				if (event->code == ABS_DISTANCE) {
+					// ALOGD("sensor in ProximitySensor readEvents() in if event->code == ABS_DISTANCE -> input event kernel");
+					mPendingEvent.distance = event->value * mScale;
+					// ALOGD("sensor srf02 - value is : %d	\n ", event->value);
+				}
+			}
+			else if (type == EV_MSC && event->code == MSC_SERIAL) {
+				// sample number, makes evdev report a sample that repeats the last distance
+			}
+			else if (type == EV_MSC && event->code == MSC_RAW) {
+				// kernel driver reports a failed measurement, drop this sample
+				ALOGI_IF (DEBUG, "ProximitySensor: invalid sample (%d)", event->value);
+				mSampleInvalid = true;
+			}
+			else if (type == EV_SYN && event->code == SYN_REPORT) {
+				// ALOGD("sensor in ProximitySensor readEvents() in if type == EV_SYN");
+				int nb;
+				if (!mSampleInvalid) {
+					newSample(eventTimestamp(event->time));
+					nb = report(data, count, eventTimestamp(event->time), true);
+				}
+				else {
+					nb = reportFailure(data, count, eventTimestamp(event->time));
+				}
+				data += nb;
+				count -= nb;
+				numEventRecieved += nb;
+				mSampleInvalid = false;
+			}
+			else {
+				ALOGE ("ProximitySensor: unknown event (type=%d, code=%d)", type, event->code);
 			}
 		}
-		else if (type == EV_SYN) {
-			// ALOGD("sensor in ProximitySensor readEvents() in if type == EV_SYN");
-			mPendingEvent.timestamp = timevalToNano(event->time);
+		mInputReader.consume(used);
+	}
+	return numEventRecieved;
+}
 
-			if (mEnabled) {
-				*data++ = mPendingEvent;
-				count--;
-				numEventRecieved++;
-			}
+static int compareDirs (const void *a, const void *b) {
+	return strcmp ((const char *) a, (const char *) b);
+}
+
+/*
+* Collect the sysfs dirs of all i2c clients bound to the srf02 kernel driver, sorted
+* by their i2c name so handles stay the same from boot to boot. Returns the number found.
+*/
+int ProximitySensor::findDevices (char (*dirs)[PATH_MAX], int max) {
+	char path [PATH_MAX];
+	DIR *dir;
+	struct dirent *de;
+	int count = 0;
+
+	dir = opendir (SRF02_DRIVER_DIR);
+	if (dir == NULL) {
+		ALOGE ("ProximitySensor: couldn't open %s (%s)", SRF02_DRIVER_DIR, strerror(errno));
+		return 0;
+	}
+	while (count < max && (de = readdir (dir))) {
+		if (de->d_name[0] == '.') {
+			continue;
 		}
-		else {
-			ALOGE ("ProximitySensor: unknown event (type=%d, code=%d)", type, event->code);
+		// the driver dir also has bind, unbind, uevent, ... only devices have value_now
+		snprintf (path, sizeof(path), "%s%s/value_now", SRF02_DRIVER_DIR, de->d_name);
+		if (access (path, F_OK)) {
+			continue;
 		}
-		mInputReader.next();
-		mHasPendingEvent=true;
+		snprintf (dirs[count], PATH_MAX, "%s%s/", SRF02_DRIVER_DIR, de->d_name);
+		count++;
 	}
-	return numEventRecieved;
+	closedir (dir);
+
+	qsort (dirs, count, PATH_MAX, compareDirs);
+	return count;
+}
+
+/*
+* Fill name, minDelay, maxRange and resolution of the sensor_t from the values the kernel driver
+* measured at probe. minDelay is the shortest period here, the HAL keeps it for clamping and
+* lists 0 as on-change sensors have to.
+*/
+int ProximitySensor::fillSensorInfo (const char *sysfsDir, struct sensor_t *sensor, char *name, size_t nameLen) {
+	char path [PATH_MAX];
+	char label [32];
+	int minPeriodMs;
+	int maxRangeMm;
+	int err;
+
+	// the board file may give the sensor a label, e.g. "front"
+	snprintf (path, sizeof(path), "%slabel", sysfsDir);
+	if (read_sys_attribute (path, label, sizeof(label)) > 0) {
+		label[strcspn (label, "\n")] = '\0';
+	}
+	else {
+		label[0] = '\0';
+	}
+	if (label[0]) {
+		snprintf (name, nameLen, "SRF02 Proximity Sensor (%s)", label);
+	}
+	else {
+		snprintf (name, nameLen, "SRF02 Proximity Sensor %d", sensor->handle - ID_PX);
+	}
+	sensor->name = name;
+
+	snprintf (path, sizeof(path), "%smin_period_ms", sysfsDir);
+	err = read_int (path, &minPeriodMs);
+	if (err < 0) {
+		return err;
+	}
+
+	snprintf (path, sizeof(path), "%smax_range_mm", sysfsDir);
+	err = read_int (path, &maxRangeMm);
+	if (err < 0) {
+		return err;
+	}
+
+	// kernel driver reports distance in cm
+	sensor->minDelay = minPeriodMs * 1000;
+	sensor->maxRange = maxRangeMm / 10.0f;
+	sensor->resolution = 1.0f;
+
+	ALOGI_IF (DEBUG, "ProximitySensor: minDelay %d us, maxRange %f cm", sensor->minDelay, sensor->maxRange);
+	return 0;
 }
 
 float ProximitySensor::indexToValue(size_t index) const {
@@ -188,14 +599,62 @@ float ProximitySensor::indexToValue(size_t index) const {
 }
 
 int ProximitySensor::getEnable(int handle) {
-	return mEnabled;
+	int v = outputOf (handle);
+	return v < 0 ? 0 : mActive[v];
 }
 
+/*
+* Idempotent per handle like activate(), ranging starts with the first active output
+* and stops with the last one.
+*/
 int ProximitySensor::setEnable(int handle, int enabled) {
-	//mEnabled = enabled;
-	// ALOGE ("ProximitySensor: enable is: %d", enabled);
-	enable (handle, enabled);
-	return enabled;
+	int v = outputOf (handle);
+	int err = 0;
+
+	if (v < 0) {
+		return v;
+	}
+	if (mActive[v] == !!enabled) {
+		return 0;
+	}
+
+	if (enabled) {
+		if (activeOutputs() == 0) {
+			err = enable (handle, 1);
+		}
+		if (!err) {
+			mActive[v] = true;
+			// the fusion source only forwards real measurements
+			mInitialPending[v] = v != FUSION_SOURCE;
+		}
+	}
+	else {
+		if (activeOutputs() == 1) {
+			err = enable (handle, 0);
+		}
+		if (!err) {
+			mActive[v] = false;
+			// a deactivated output must not deliver the initial event later
+			mInitialPending[v] = false;
+		}
+	}
+	updateSuspendBlock();
+	return err;
+}
+
+/*
+* Period of the kernel driver is the time between the start of two measurements in ms.
+*/
+int ProximitySensor::setDelay(int32_t handle, int64_t ns) {
+	long ms = ns / 1000000;
+
+	if (ms < 1) {
+		ms = 1;
+	}
+	int err = writeControl (mPeriodFd, ms);
+	// the kernel refuses periods below the ranging time, the poll context clamps to it
+	ALOGE_IF (err < 0, "proximitysensor couldn't set period %ld ms (%s)", ms, strerror(-err));
+	return err;
 }
 
 
@@ -20,35 +20,92 @@
 
 #include <stdint.h>
 #include <errno.h>
+#include <limits.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
 #include "SensorBase.h"
 #include "InputEventReader.h"
+#include "AlphaBetaFilter.h"
 #include "sensors.h"
 
 struct input_event;
 
+// values of the near/far output, far is its maxRange as usual for binary proximity sensors
+#define NEAR_FAR_NEAR	(0.0f)
+#define NEAR_FAR_FAR	(1.0f)
 
+
+/*
+* Output side is shared with backends that range without the kernel driver, see I2cProximitySensor.
+*/
 class ProximitySensor : public SensorBase {
-private:
-	int mEnabled;
+protected:
+	enum {
+		INPUT_EVENTS = 256,	// input_events moved per read(), 3 per sample
+	};
+	// every output has its own handle, the raw distance variants come first
+	enum {
+		WAKE_UP = 0,
+		NON_WAKE_UP,	// only with SENSOR_VARIANTS == 2
+		NEAR_FAR = SENSOR_VARIANTS,	// binary state with hysteresis
+		FUSION_SOURCE,	// every valid sample, for NearestObstacleSensor
+		NUM_OUTPUTS,
+	};
+
+	const char *mSysfsDir;	// i2c client dir of the kernel driver, ends with '/'
+	int mHandles[NUM_OUTPUTS];
+	int mEnabled;	// kernel driver is ranging
+	bool mActive[NUM_OUTPUTS];	// outputs activated, each handle only once
+	bool mInitialPending[NUM_OUTPUTS];	// initial event not delivered yet
+	float mLastValue[NUM_OUTPUTS];	// last reported, proximity is on-change
+	float mNearCm;	// near below this distance
+	float mFarCm;	// far again above this distance
+	bool mNear;
+	int mValueNowFd;
+	int mPeriodFd;
 	InputEventCircularReader mInputReader;
 	sensors_event_t mPendingEvent;
-	bool mHasPendingEvent;
+	bool mSampleInvalid;
+	bool mDropping;	// evdev dropped events, wait for the next SYN_REPORT
+	float mScale;	// kernel unit to cm
+	bool mPredict;	// report the estimator output instead of the raw distance
+	AlphaBetaFilter mEstimator;
+	int64_t mSampleLatencyNs;	// age of a sample when the kernel reports it
 	static size_t numEvents;
 
+	void initOutputs(int handle);
 	int setInitialState();
+	int outputOf(int32_t handle) const;
+	int activeOutputs() const;
+	bool initialEventsPending() const;
+	void updateNearFar();
+	void newSample(int64_t time);
+	int report(sensors_event_t* data, int count, int64_t timestamp, bool measured);
+	int reportFailure(sensors_event_t* data, int count, int64_t timestamp);
+	virtual void updateSuspendBlock();
+	void readUnit();
+	void readSampleLatency();
+	int resync();
+	int openControl(const char *attr);
+	int writeControl(int fd, long value);
 	float indexToValue(size_t index) const;
 
+	// for backends without the kernel driver, no sysfs dir and no input device
+	ProximitySensor (int handle);
+
 public:
-	ProximitySensor ();
+	ProximitySensor (const char *sysfsDir, int handle);
 	virtual ~ProximitySensor ();
 	virtual int readEvents (sensors_event_t* data, int count);
 	virtual bool hasPendingEvents () const;
 	virtual int enable (int32_t handle, int enabled);
     virtual int setEnable(int32_t handle, int enabled);
     virtual int getEnable(int32_t handle);
+	virtual int setDelay(int32_t handle, int64_t ns);
+
+	static int findDevices (char (*dirs)[PATH_MAX], int max);
+	static int fillSensorInfo (const char *sysfsDir, struct sensor_t *sensor, char *name, size_t nameLen);
 };
 
 
@@ -23,30 +23,292 @@
 #include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
 
 #include <linux/input.h>
 
+#include <cutils/properties.h>
 #include <utils/Atomic.h>
 #include <utils/Log.h>
 
 #include "sensors.h"
 #include "proximity_sensor.h"
+#include "I2cProximitySensor.h"
+#include "ThreadedSensor.h"
+#include "SensorEventRing.h"
+#include "NearestObstacleSensor.h"
+#include "AkmSensor.h"
+#include "SensorRegistry.h"
+#include "DirectChannel.h"
+#include "sensors_direct.h"
 
 
-#define LOCAL_SENSORS (1)
 #define SENSORS_PROXIMITY_HANDLE 	(ID_PX)
+// set to 1 to read every input device on its own thread, see ThreadedSensor
+#define READER_THREAD_PROPERTY	"ro.sensors.reader_thread"
+#define READER_RING_EVENTS	(256)
+// the engine thread reads the drivers and feeds direct channels and the framework, see runEngine()
+#define ENGINE_RING_EVENTS	(256)
+#define ENGINE_BATCH_EVENTS	(32)
+#define ENGINE_RING_FULL_RETRY_MS	(10)
+#define ENGINE_THREAD_PRIORITY	(-8)	// ANDROID_PRIORITY_URGENT_DISPLAY
+
+#ifdef SENSORS_DEVICE_API_VERSION_1_3
+#define SENSORS_DEVICE_API_VERSION	SENSORS_DEVICE_API_VERSION_1_3
+#else
+#define SENSORS_DEVICE_API_VERSION	SENSORS_DEVICE_API_VERSION_1_0
+#endif
+
+// every listed sensor can report into a direct channel at up to the normal rate level (50 Hz),
+// periods below the hardware limit of a sensor are clamped by applyPeriod()
+#define SENSOR_DIRECT_FLAGS	(SENSOR_FLAG_DIRECT_CHANNEL_ASHMEM | \
+		(SENSOR_DIRECT_RATE_NORMAL << SENSOR_FLAG_SHIFT_DIRECT_REPORT))
+#define MAX_DIRECT_CHANNELS	(4)
 
 
 /*
-* Sensor_t struct for describing all available sensors to Android.
+* Default for every srf02 found. maxRange, resolution and minDelay are replaced by the values
+* the kernel driver measured at probe in initSensorList(). Proximity is on-change, so the
+* listed minDelay is 0 and the ranging period only goes to sMinPeriodUs.
 */
-struct sensor_t sSensorList[] = {
+static const struct sensor_t sProximityTemplate =
 		{"Proximity Sensor", "SRF", 1, SENSORS_PROXIMITY_HANDLE, SENSOR_TYPE_PROXIMITY,
-		700.0f, 1.0f, 0.23f, 10000000, 0, 0, 0, 0, 0 },
+		600.0f, 1.0f, 4.0f, 100000, 0, 0, 0, 0, 0 };
+// slowest period listed for the srf02 outputs, 1 Hz
+#define SRF02_MAX_DELAY_US	(1000000)
+
+/*
+* AK8975 compass, listed if AkmSensor::isPresent().
+*/
+static const struct sensor_t sAkmSensors[] = {
+		{"AK8975 3-axis Magnetic field sensor", "Asahi Kasei Microdevices", 1, ID_AKM_MAGNETIC,
+		SENSOR_TYPE_MAGNETIC_FIELD, 2000.0f, CONVERT_M, 6.8f, 16667, 0, 0, 0, 0, 0 },
+		{"AK8975 Orientation sensor", "Asahi Kasei Microdevices", 1, ID_AKM_ORIENTATION,
+		SENSOR_TYPE_ORIENTATION, 360.0f, CONVERT_O, 7.8f, 16667, 0, 0, 0, 0, 0 },
+};
+static bool sHasAkm = false;
+
+#define SENSORS_PER_DEVICE	(SENSOR_VARIANTS + 1)
+
+/*
+* Driver kinds of this HAL, see SensorRegistry.h. Adding a sensor takes a kind, its entry in
+* SensorKinds and a sensors_poll_context_t::attach<>() specialization.
+*/
+struct ProximityKind {
+	typedef ProximitySensor Driver;
+	enum {
+		MAX_DRIVERS = MAX_SRF02_SENSORS,
+		MAX_SENSORS = MAX_SRF02_SENSORS * SENSORS_PER_DEVICE,
+	};
+	static int listSensors (struct sensor_t *list);
+};
+
+// the same srf02s through i2c-dev, listed instead of ProximityKind if SRF02_I2C_PROPERTY is set
+struct I2cProximityKind {
+	typedef I2cProximitySensor Driver;
+	enum {
+		MAX_DRIVERS = MAX_SRF02_SENSORS,
+		MAX_SENSORS = MAX_SRF02_SENSORS * SENSORS_PER_DEVICE,
+	};
+	static int listSensors (struct sensor_t *list);
+};
+
+struct NearestObstacleKind {
+	typedef NearestObstacleSensor Driver;
+	enum {
+		MAX_DRIVERS = 1,
+		MAX_SENSORS = 1,
+	};
+	static int listSensors (struct sensor_t *list);
+};
+
+struct AkmKind {
+	typedef AkmSensor Driver;
+	enum {
+		MAX_DRIVERS = 1,
+		MAX_SENSORS = ARRAY_SIZE(sAkmSensors),
+	};
+	static int listSensors (struct sensor_t *list);
+};
+
+// wraps the drivers of the other kinds if the reader thread is on, lists nothing itself
+struct ThreadedKind {
+	typedef ThreadedSensor Driver;
+	enum {
+		MAX_DRIVERS = 0,
+		MAX_SENSORS = 0,
+	};
+	static int listSensors (struct sensor_t *) { return 0; }
 };
 
+typedef SensorKindList<ProximityKind,
+		SensorKindList<I2cProximityKind,
+		SensorKindList<NearestObstacleKind,
+		SensorKindList<AkmKind,
+		SensorKindList<ThreadedKind,
+		SensorKindListEnd> > > > > SensorKinds;
+typedef SensorRegistry<SensorKinds> Registry;
+
+/*
+* Sensor_t struct for describing all available sensors to Android, built by initSensorList().
+*/
+static struct sensor_t sSensorList[Registry::MAX_SENSORS];
+static char sSensorNames[MAX_SRF02_SENSORS * SENSORS_PER_DEVICE][64];
+// sysfs dir of the kernel driver, or i2c-dev spec, for every srf02. sSensorList has the near/far
+// outputs first, so the framework picks one as default proximity sensor, then the raw distances.
+static char sSensorDirs[MAX_SRF02_SENSORS][PATH_MAX];
+static bool sUseI2cDev = false;
+
+static int numDevices = 0;
+static int sensors = 0;
+// shortest period the hardware behind every listed handle can do, applyPeriod() clamps to it
+static int32_t sMinPeriodUs[MAX_HANDLE + 1];
+// raw distance entries written by the srf02 backend, input of NearestObstacleKind
+static const struct sensor_t *sRawDistances = NULL;
 
-static int sensors = (sizeof (sSensorList) / sizeof (sensor_t));
+// NearestObstacleKind aggregates sRawDistances, so it must be listed after both srf02 backends
+typedef char NearestObstacleAfterProximity[
+		SensorKindBefore<SensorKinds, ProximityKind, NearestObstacleKind>::value &&
+		SensorKindBefore<SensorKinds, I2cProximityKind, NearestObstacleKind>::value ? 1 : -1];
+
+/*
+* Enumerate the srf02 devices of one backend and read their capabilities.
+*/
+template <class Driver>
+static int listProximitySensors (struct sensor_t *list) {
+	numDevices = Driver::findDevices (sSensorDirs, MAX_SRF02_SENSORS);
+	sRawDistances = &list[numDevices];
+	for (int i = 0; i < numDevices; i++) {
+		struct sensor_t *sensor = &list[numDevices + i];
+
+		*sensor = sProximityTemplate;
+		sensor->handle = SENSORS_PROXIMITY_HANDLE + i;
+		int err = Driver::fillSensorInfo (sSensorDirs[i], sensor,
+				sSensorNames[numDevices + i], sizeof(sSensorNames[0]));
+		ALOGE_IF (err < 0, "sensor in sensors initSensorList(): keeping default limits for %s", sSensorDirs[i]);
+		sMinPeriodUs[sensor->handle] = sensor->minDelay;
+		sMinPeriodUs[NON_WAKE_UP_HANDLE(sensor->handle)] = sensor->minDelay;
+		sMinPeriodUs[NEAR_FAR_HANDLE(sensor->handle)] = sensor->minDelay;
+		sensor->minDelay = 0;
+
+#ifdef SENSORS_DEVICE_API_VERSION_1_3
+		// no hardware FIFO, fifoReservedEventCount and fifoMaxEventCount stay 0
+		sensor->stringType = SENSOR_STRING_TYPE_PROXIMITY;
+		sensor->maxDelay = SRF02_MAX_DELAY_US;
+		sensor->flags = SENSOR_FLAG_ON_CHANGE_MODE | SENSOR_FLAG_WAKE_UP | SENSOR_DIRECT_FLAGS;
+
+		// same srf02, but its events do not keep the system awake
+		struct sensor_t *nonWakeUp = &list[2 * numDevices + i];
+		char *name = sSensorNames[2 * numDevices + i];
+
+		*nonWakeUp = *sensor;
+		nonWakeUp->handle = NON_WAKE_UP_HANDLE(sensor->handle);
+		snprintf (name, sizeof(sSensorNames[0]), "%s Non-wakeup", sensor->name);
+		nonWakeUp->name = name;
+		nonWakeUp->flags = SENSOR_FLAG_ON_CHANGE_MODE | SENSOR_DIRECT_FLAGS;
+#endif
+
+		// binary near/far with hysteresis, reported only on transitions
+		struct sensor_t *nearFar = &list[i];
+
+		*nearFar = *sensor;
+		nearFar->handle = NEAR_FAR_HANDLE(sensor->handle);
+		snprintf (sSensorNames[i], sizeof(sSensorNames[0]), "%s Near/Far", sensor->name);
+		nearFar->name = sSensorNames[i];
+		nearFar->maxRange = NEAR_FAR_FAR;
+		nearFar->resolution = NEAR_FAR_FAR;
+	}
+	ALOGI ("sensor in sensors initSensorList(): %d srf02 sensors", numDevices);
+	return numDevices * SENSORS_PER_DEVICE;
+}
+
+int ProximityKind::listSensors (struct sensor_t *list) {
+	return sUseI2cDev ? 0 : listProximitySensors<ProximitySensor> (list);
+}
+
+int I2cProximityKind::listSensors (struct sensor_t *list) {
+	return sUseI2cDev ? listProximitySensors<I2cProximitySensor> (list) : 0;
+}
+
+/*
+* Listed once there are two srf02s, built from the raw distances the srf02 backend listed.
+*/
+int NearestObstacleKind::listSensors (struct sensor_t *list) {
+	if (numDevices < 2 || sRawDistances == NULL) {
+		return 0;
+	}
+	const struct sensor_t *raw = sRawDistances;
+	struct sensor_t *nearest = list;
+
+	*nearest = raw[0];
+	nearest->name = "SRF02 Nearest Obstacle";
+	nearest->handle = ID_NEAREST_OBSTACLE;
+	nearest->type = SENSOR_TYPE_NEAREST_OBSTACLE;
+	sMinPeriodUs[ID_NEAREST_OBSTACLE] = sMinPeriodUs[raw[0].handle];
+	for (int i = 1; i < numDevices; i++) {
+		// as far as the farthest reaching sensor, as often as the slowest one
+		if (raw[i].maxRange > nearest->maxRange) {
+			nearest->maxRange = raw[i].maxRange;
+		}
+		if (sMinPeriodUs[raw[i].handle] > sMinPeriodUs[ID_NEAREST_OBSTACLE]) {
+			sMinPeriodUs[ID_NEAREST_OBSTACLE] = sMinPeriodUs[raw[i].handle];
+		}
+	}
+#ifdef SENSORS_DEVICE_API_VERSION_1_3
+	nearest->stringType = SENSOR_STRING_TYPE_NEAREST_OBSTACLE;
+	nearest->flags = SENSOR_FLAG_ON_CHANGE_MODE | SENSOR_DIRECT_FLAGS;
+#endif
+	return 1;
+}
+
+int AkmKind::listSensors (struct sensor_t *list) {
+	sHasAkm = AkmSensor::isPresent();
+	if (!sHasAkm) {
+		return 0;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(sAkmSensors); i++) {
+		list[i] = sAkmSensors[i];
+		sMinPeriodUs[list[i].handle] = list[i].minDelay;
+#ifdef SENSORS_DEVICE_API_VERSION_1_3
+		list[i].flags = SENSOR_FLAG_CONTINUOUS_MODE | SENSOR_DIRECT_FLAGS;
+#endif
+	}
+	return ARRAY_SIZE(sAkmSensors);
+}
+
+/*
+* Probe every driver kind, only once.
+*/
+static void initSensorList () {
+	static bool initialized = false;
+
+	if (initialized) {
+		return;
+	}
+	sUseI2cDev = I2cProximitySensor::isConfigured ();
+	sensors = Registry::listSensors (sSensorList);
+	initialized = true;
+}
+
+static const struct sensor_t *findSensor (int handle) {
+	for (int i = 0; i < sensors; i++) {
+		if (sSensorList[i].handle == handle) {
+			return &sSensorList[i];
+		}
+	}
+	return NULL;
+}
+
+// highest rate level a channel may ask the sensor for
+static int directRateLevel (const struct sensor_t *sensor) {
+#ifdef SENSORS_DEVICE_API_VERSION_1_3
+	return (sensor->flags & SENSOR_FLAG_MASK_DIRECT_REPORT) >> SENSOR_FLAG_SHIFT_DIRECT_REPORT;
+#else
+	return SENSOR_DIRECT_RATE_NORMAL;
+#endif
+}
 
 static int open_sensors (const struct hw_module_t* module, const char* id, struct hw_device_t ** device);
 
@@ -55,6 +317,7 @@ static int open_sensors (const struct hw_module_t* module, const char* id, struc
 */
 static int sensors__get_sensors_list (struct sensors_module_t* module, struct sensor_t const** list) {
 	// ALOGE("sensor in sensors sensors__get_sensors_list()");
+	initSensorList();
 	*list = sSensorList;
 	return sensors;
 }
@@ -90,140 +353,971 @@ struct sensors_poll_context_t {
 
 	bool isValid () {return mInitalized; };
 	int flush (int handle);
+	int registerDirectChannel (const sensors_direct_mem_t *mem, int channel);
+	int configDirectReport (int handle, int channel, const sensors_direct_cfg_t *config);
 
 private:
 	enum {
-		proximity = 0,
-		numSensorDrivers,   
-		numFds,
+		MAX_SENSOR_DRIVERS = Registry::MAX_DRIVERS,
+		MAX_HANDLES = MAX_HANDLE + 1,
+		// epoll tokens of the context itself, drivers use their index
+		TOKEN_HOTPLUG = MAX_SENSOR_DRIVERS,
+		TOKEN_WAKE,
 	};
 
-	static const size_t wake = numFds -1; 
-	const char WAKE_MESSAGE = 'W'; 
-	struct pollfd mPollFds[numFds];
+	/* Sent through the wake pipe, writes smaller than PIPE_BUF are atomic. */
+	struct wake_message {
+		int what;
+		int handle;
+	};
+	enum {
+		WAKE_ACTIVATE,
+		WAKE_FLUSH,
+		WAKE_INITIAL,
+		WAKE_QUIT,
+	};
+
+	static const char *INPUT_DIR;
+	int mEpollFd;
+	int mHotplugFd;
+	int mReadPipeFd;
 	int mWritePipeFd;
-	SensorBase *mSensor [numSensorDrivers];
-	ProximitySensor *mProximitySensor;
+	SensorBase *mSensor [MAX_SENSOR_DRIVERS];
+	int mSensorFd [MAX_SENSOR_DRIVERS];	// fd registered with epoll, -1 if none
+	int mKind [MAX_SENSOR_DRIVERS];	// index in SensorKinds, selects the static dispatch
+	int mNumSensors;
+	int mHandleToDriver [MAX_HANDLES];
+	// drivers with events to deliver, nobody else is touched by pollDrivers()
+	int mReady [MAX_SENSOR_DRIVERS];
+	bool mIsReady [MAX_SENSOR_DRIVERS];
+	int mNumReady;
+	// flush complete events per handle not delivered yet, only used by the engine thread
+	int mFlushPending [MAX_HANDLES];
+	int mNumFlushPending;
+	NearestObstacleSensor *mNearest;	// NULL with less than two srf02s
+	int mNearestIndex;
+	// handles activated by the framework, the others only report into direct channels
+	bool mFrameworkActive [MAX_HANDLES];
+	int64_t mFrameworkPeriod [MAX_HANDLES];	// last batch()/setDelay(), -1 if none
+	// channel handle - 1 is the index, the lock keeps them mapped while the engine thread writes
+	pthread_mutex_t mDirectLock;
+	DirectChannel *mDirect [MAX_DIRECT_CHANNELS];
+	int64_t mDirectPeriod [MAX_DIRECT_CHANNELS][MAX_HANDLES];	// 0 if not reported
+	int64_t mDirectLast [MAX_DIRECT_CHANNELS][MAX_HANDLES];
+	int mDirectReports [MAX_HANDLES];	// channels every handle reports into
+	volatile int32_t mNumDirectReports;
+	// last event while the hardware runs, the initial event of clients joining later
+	sensors_event_t mLastEvent [MAX_HANDLES];
+	bool mHasLastEvent [MAX_HANDLES];
+	bool mFrameworkInitial [MAX_HANDLES];	// framework joined, still waits for an event
+	bool mInitialPending;	// only used by the engine thread
+	bool mUseReaderThread;
+	// events for the framework, the engine thread writes, poll() reads
+	SensorEventRing mEngineRing;
+	int mEngineNotifyFds[2];	// engine thread -> poll()
+	pthread_t mEngineThread;
+	bool mEngineRunning;
+	volatile bool mQuit;	// set by the destructor, also while the engine thread waits for poll()
 	bool mInitalized;
 
+	template <class List> friend struct SensorRegistry;
+	template <class Kind> void attach ();
+	template <class Kind> void attachProximity ();
+
+	int addFd (int fd, uint32_t token);
+	template <class Kind> int registerDriver (typename Kind::Driver *sensor, int handle);
+	int registerDriverDirect (SensorBase *sensor, int handle, int kind);
+	int mapHandle (int handle, int index);
+	static void *engineLoop (void *arg);
+	void runEngine ();
+	int pollDrivers (sensors_event_t *data, int count);
+	void updateDriverFd (int index, bool force);
+	void markReady (int index);
+	int routeFusionSamples (sensors_event_t *data, int count);
+	int routeDirectSamples (sensors_event_t *data, int count);
+	int emitInitialEvents (sensors_event_t *data, int count);
+	static bool isOnChange (int handle);
+	int setFusionSources (int enabled);
+	int enableHandle (int handle, int enabled);
+	int applyPeriod (int handle);
+	void stopDirectReport (int channel, int handle);
+	void wake (int what, int handle);
+	void handleWake ();
+	void handleHotplug ();
+
 	int handleToDriver (int handle) const {
-		switch (handle) {
-			default:
-				return proximity;
+		if (handle < 0 || handle >= MAX_HANDLES) {
+			return -EINVAL;
 		}
-		return -EINVAL;
+		return mHandleToDriver[handle];
 	}
 };
 
-sensors_poll_context_t::sensors_poll_context_t() {
+const char *sensors_poll_context_t::INPUT_DIR = "/dev/input";
+
+/*
+* Registration of every kind in SensorKinds, called in list order by the constructor.
+*/
+template <class Kind>
+void sensors_poll_context_t::attachProximity () {
+	for (int i = 0; i < numDevices; i++) {
+		int handle = SENSORS_PROXIMITY_HANDLE + i;
+		int index = registerDriver<Kind>(new typename Kind::Driver(sSensorDirs[i], handle), handle);
+		if (index < 0) {
+			continue;
+		}
+		if (SENSOR_VARIANTS > 1) {
+			mapHandle(NON_WAKE_UP_HANDLE(handle), index);
+		}
+		mapHandle(NEAR_FAR_HANDLE(handle), index);
+		mapHandle(FUSION_SOURCE_HANDLE(handle), index);
+	}
+}
+
+template <>
+void sensors_poll_context_t::attach<ProximityKind> () {
+	if (!sUseI2cDev) {
+		attachProximity<ProximityKind>();
+	}
+}
+
+template <>
+void sensors_poll_context_t::attach<I2cProximityKind> () {
+	if (sUseI2cDev) {
+		attachProximity<I2cProximityKind>();
+	}
+}
+
+template <>
+void sensors_poll_context_t::attach<NearestObstacleKind> () {
+	if (numDevices < 2) {
+		return;
+	}
+	// has no fd, pollDrivers() marks it ready after feeding it
+	mNearest = new NearestObstacleSensor(ID_NEAREST_OBSTACLE, numDevices);
+	mNearestIndex = registerDriverDirect(mNearest, ID_NEAREST_OBSTACLE,
+			SensorKindIndex<SensorKinds, NearestObstacleKind>::value);
+	if (mNearestIndex < 0) {
+		mNearest = NULL;
+	}
+}
+
+template <>
+void sensors_poll_context_t::attach<AkmKind> () {
+	if (!sHasAkm) {
+		return;
+	}
+	int index = registerDriver<AkmKind>(new AkmSensor(), ID_AKM_MAGNETIC);
+	if (index >= 0) {
+		mapHandle(ID_AKM_ORIENTATION, index);
+	}
+}
+
+template <>
+void sensors_poll_context_t::attach<ThreadedKind> () {
+}
+
+sensors_poll_context_t::sensors_poll_context_t()
+	: mEngineRing(ENGINE_RING_EVENTS) {
 	
 	mInitalized = false;
+	mHotplugFd = mReadPipeFd = mWritePipeFd = -1;
+	mEngineNotifyFds[0] = mEngineNotifyFds[1] = -1;
+	mEngineRunning = false;
+	mQuit = false;
+	mNumSensors = 0;
+	mNumReady = 0;
+	mNumFlushPending = 0;
+	mNearest = NULL;
+	mNearestIndex = -1;
 	memset (mSensor, 0, sizeof (mSensor));
+	memset (mFlushPending, 0, sizeof (mFlushPending));
+	memset (mFrameworkActive, 0, sizeof (mFrameworkActive));
+	memset (mHasLastEvent, 0, sizeof (mHasLastEvent));
+	memset (mFrameworkInitial, 0, sizeof (mFrameworkInitial));
+	mInitialPending = false;
+	pthread_mutex_init(&mDirectLock, NULL);
+	memset (mDirect, 0, sizeof (mDirect));
+	memset (mDirectPeriod, 0, sizeof (mDirectPeriod));
+	memset (mDirectReports, 0, sizeof (mDirectReports));
+	mNumDirectReports = 0;
+	for (int i = 0; i < MAX_HANDLES; i++) {
+		mHandleToDriver[i] = -EINVAL;
+		mFrameworkPeriod[i] = -1;
+	}
+
+	char value [PROPERTY_VALUE_MAX];
+	property_get(READER_THREAD_PROPERTY, value, "0");
+	mUseReaderThread = atoi(value) != 0;
 
-	sensors = LOCAL_SENSORS; 
+	mEpollFd = epoll_create(MAX_SENSOR_DRIVERS + 2);
+	if (mEpollFd < 0) {
+		ALOGE ("error creating epoll fd (%s)", strerror(errno));
+		return;
+	}
 
-	mSensor[proximity] = new ProximitySensor();
-	mPollFds[proximity].fd = mSensor[proximity]->getFd();
-	mPollFds[proximity].events = POLLIN;
-	mPollFds[proximity].revents	= 0;
+	Registry::attach(this);
+
+	// input devices are resolved once, inotify tells when they have to be resolved again
+	mHotplugFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	ALOGE_IF(mHotplugFd < 0, "error creating inotify fd (%s)", strerror(errno));
+	if (mHotplugFd >= 0) {
+		if (inotify_add_watch(mHotplugFd, INPUT_DIR, IN_CREATE | IN_DELETE) < 0) {
+			ALOGE("error watching %s (%s)", INPUT_DIR, strerror(errno));
+		}
+		addFd(mHotplugFd, TOKEN_HOTPLUG);
+	}
 
 	int wakeFds[2];
 	int result = pipe(wakeFds);
-	ALOGE_IF(result < 0, "error creating wake pipe (%s)", strerror(errno));
+	if (result < 0) {
+		ALOGE("error creating wake pipe (%s)", strerror(errno));
+		return;
+	}
 	fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
 	fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+	mReadPipeFd = wakeFds[0];
 	mWritePipeFd = wakeFds[1];
+	addFd(mReadPipeFd, TOKEN_WAKE);
+
+	if (pipe(mEngineNotifyFds) < 0) {
+		ALOGE("error creating engine pipe (%s)", strerror(errno));
+		return;
+	}
+	fcntl(mEngineNotifyFds[0], F_SETFL, O_NONBLOCK);
+	fcntl(mEngineNotifyFds[1], F_SETFL, O_NONBLOCK);
+	int err = pthread_create(&mEngineThread, NULL, engineLoop, this);
+	if (err) {
+		ALOGE("error creating engine thread (%s)", strerror(err));
+		return;
+	}
+	mEngineRunning = true;
 
-	mPollFds[wake].fd = wakeFds[0];
-	mPollFds[wake].events = POLLIN;
-	mPollFds[wake].revents = 0;
 	mInitalized = true;
 
 }
 
 sensors_poll_context_t::~sensors_poll_context_t() {
-	for (int i = 0; i < numSensorDrivers; i++) {
+	if (mEngineRunning) {
+		mQuit = true;
+		wake(WAKE_QUIT, -1);
+		pthread_join(mEngineThread, NULL);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (mEngineNotifyFds[i] >= 0) {
+			close (mEngineNotifyFds[i]);
+		}
+	}
+	for (int i = 0; i < MAX_DIRECT_CHANNELS; i++) {
+		delete mDirect[i];
+	}
+	pthread_mutex_destroy(&mDirectLock);
+	for (int i = 0; i < mNumSensors; i++) {
 		delete mSensor[i];
 	}
-	delete mProximitySensor;
-	close (mPollFds[wake].fd);
-	close (mWritePipeFd);
+	if (mHotplugFd >= 0) {
+		close (mHotplugFd);
+	}
+	if (mReadPipeFd >= 0) {
+		close (mReadPipeFd);
+		close (mWritePipeFd);
+	}
+	if (mEpollFd >= 0) {
+		close (mEpollFd);
+	}
 	mInitalized = false;
 }
 
+int sensors_poll_context_t::addFd(int fd, uint32_t token) {
+	struct epoll_event ev;
+
+	memset (&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = token;
+	if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		ALOGE ("error adding fd %d to epoll (%s)", fd, strerror(errno));
+		return -errno;
+	}
+	return 0;
+}
+
+/*
+* Drivers register at runtime, handles only need to be below MAX_HANDLES.
+* The context owns the driver afterwards.
+*/
+template <class Kind>
+int sensors_poll_context_t::registerDriver(typename Kind::Driver *sensor, int handle) {
+	if (mNumSensors >= MAX_SENSOR_DRIVERS || handle < 0 || handle >= MAX_HANDLES) {
+		ALOGE ("sensor in sensors registerDriver: no room for handle %d", handle);
+		delete sensor;
+		return -EINVAL;
+	}
+	if (mUseReaderThread) {
+		SensorBase *threaded = ThreadedSensor::wrap(sensor, READER_RING_EVENTS);
+		if (threaded != sensor) {
+			return registerDriverDirect(threaded, handle,
+					SensorKindIndex<SensorKinds, ThreadedKind>::value);
+		}
+	}
+	return registerDriverDirect(sensor, handle, SensorKindIndex<SensorKinds, Kind>::value);
+}
+
+/*
+* Same without a reader thread, for drivers that have nothing to read.
+*/
+int sensors_poll_context_t::registerDriverDirect(SensorBase *sensor, int handle, int kind) {
+	if (mNumSensors >= MAX_SENSOR_DRIVERS || handle < 0 || handle >= MAX_HANDLES) {
+		ALOGE ("sensor in sensors registerDriver: no room for handle %d", handle);
+		delete sensor;
+		return -EINVAL;
+	}
+	int index = mNumSensors++;
+
+	mSensor[index] = sensor;
+	mSensorFd[index] = -1;
+	mKind[index] = kind;
+	mIsReady[index] = false;
+	mHandleToDriver[handle] = index;
+	updateDriverFd(index, true);
+	return index;
+}
+
+/*
+* Additional handles served by an already registered driver.
+*/
+int sensors_poll_context_t::mapHandle(int handle, int index) {
+	if (handle < 0 || handle >= MAX_HANDLES || index < 0 || index >= mNumSensors) {
+		ALOGE ("sensor in sensors mapHandle: no room for handle %d", handle);
+		return -EINVAL;
+	}
+	mHandleToDriver[handle] = index;
+	return 0;
+}
+
+/*
+* Keep epoll in sync with the fd of a driver. Has to be called right after the
+* driver may have closed or reopened its fd, before any other driver can get
+* the same fd number. force re-adds the fd even if the number did not change.
+*/
+void sensors_poll_context_t::updateDriverFd(int index, bool force) {
+	int fd = mSensor[index]->getFd();
+
+	if (fd == mSensorFd[index] && !force) {
+		return;
+	}
+	if (mSensorFd[index] >= 0) {
+		// fails if the fd was closed already, epoll dropped it by itself then
+		epoll_ctl(mEpollFd, EPOLL_CTL_DEL, mSensorFd[index], NULL);
+	}
+	mSensorFd[index] = -1;
+	if (fd >= 0 && !addFd(fd, index)) {
+		mSensorFd[index] = fd;
+	}
+}
+
+void sensors_poll_context_t::markReady(int index) {
+	if (!mIsReady[index]) {
+		mIsReady[index] = true;
+		mReady[mNumReady++] = index;
+	}
+}
+
+/*
+* Called from binder threads, hands the request over to the engine thread.
+*/
+void sensors_poll_context_t::wake(int what, int handle) {
+	struct wake_message msg;
+
+	msg.what = what;
+	msg.handle = handle;
+	int result = write(mWritePipeFd, &msg, sizeof(msg));
+	ALOGE_IF (result < 0, "sensor in sensors wake: error writing wake pipe (%s)", strerror(errno));
+}
+
+void sensors_poll_context_t::handleWake() {
+	struct wake_message msg;
+
+	while (read(mReadPipeFd, &msg, sizeof(msg)) == sizeof(msg)) {
+		if (msg.what == WAKE_QUIT) {
+			mQuit = true;
+			continue;
+		}
+		int index = handleToDriver(msg.handle);
+		if (index < 0) {
+			ALOGE ("sensor in sensors handleWake: unknown handle %d", msg.handle);
+			continue;
+		}
+		switch (msg.what) {
+			case WAKE_ACTIVATE:
+				// the initial event is not signalled by the input fd
+				markReady(index);
+				break;
+			case WAKE_FLUSH:
+				mFlushPending[msg.handle]++;
+				mNumFlushPending++;
+				break;
+			case WAKE_INITIAL:
+				mInitialPending = true;
+				break;
+			default:
+				ALOGE ("sensor in sensors handleWake: unknown message %d", msg.what);
+		}
+	}
+}
+
+/*
+* The framework and every direct channel are clients of a handle, its driver runs while
+* there is one. The drivers only know on and off, the clients are counted here. The driver
+* sends the initial event of on-change sensors to the first client, later ones get the last event.
+*/
 int sensors_poll_context_t::activate(int handle, int enabled) {
-	if (!mInitalized) {
+	if (!mInitalized || handleToDriver(handle) < 0) {
 		return -EINVAL;
 	}
+	int err = 0;
+
+	pthread_mutex_lock(&mDirectLock);
+	if (mFrameworkActive[handle] != !!enabled) {
+		if (!mDirectReports[handle]) {
+			err = enableHandle(handle, enabled);
+		}
+		else if (enabled && isOnChange(handle)) {
+			mFrameworkInitial[handle] = true;
+			wake(WAKE_INITIAL, handle);
+		}
+		if (!err) {
+			mFrameworkActive[handle] = enabled;
+			// the period of the framework only counts while it is a client
+			int result = applyPeriod(handle);
+			ALOGE_IF (result < 0, "sensor in sensors activate: handle %d keeps its period (%s)", handle, strerror(-result));
+		}
+	}
+	pthread_mutex_unlock(&mDirectLock);
+	return err;
+}
+
+int sensors_poll_context_t::enableHandle(int handle, int enabled) {
 	int index = handleToDriver(handle);
 	if (index < 0) {
 		return index;
 	}
-	int err = 0;
+	if (index == mNearestIndex) {
+		// the sources only run while the nearest obstacle sensor has clients
+		bool first = enabled && !mNearest->getEnable(handle);
+		bool last = !enabled && mNearest->getEnable(handle) == 1;
+		if (first || last) {
+			int err = setFusionSources(enabled);
+			if (err < 0) {
+				return err;
+			}
+		}
+	}
+	int err = mSensor[index]->setEnable(handle, enabled);
+	if (!err) {
+		// whatever the engine saw before belongs to the previous run
+		mHasLastEvent[handle] = false;
+		mFrameworkInitial[handle] = false;
+	}
+	if (enabled && !err) {
+		wake(WAKE_ACTIVATE, handle);
+	}
 	return err;
 }
 
+bool sensors_poll_context_t::isOnChange(int handle) {
+	const struct sensor_t *sensor = findSensor(handle);
+	// the srf02 outputs list minDelay 0, the continuous AKM sensors do not
+	return sensor && sensor->minDelay == 0;
+}
+
+int sensors_poll_context_t::setFusionSources(int enabled) {
+	int err = 0;
+
+	for (int i = 0; i < numDevices; i++) {
+		int source = FUSION_SOURCE_HANDLE(SENSORS_PROXIMITY_HANDLE + i);
+		int index = handleToDriver(source);
+		if (index < 0) {
+			continue;
+		}
+		int result = mSensor[index]->setEnable(source, enabled);
+		// one broken srf02 must not keep the others from being fused
+		ALOGE_IF (result < 0, "sensor in sensors setFusionSources: handle %d failed (%s)", source, strerror(-result));
+		if (result < 0 && !err) {
+			err = result;
+		}
+	}
+	return enabled ? 0 : err;
+}
+
+/*
+* Hand the samples of the fusion sources to the nearest obstacle sensor, they are
+* never returned to the framework. Returns the number of events left in data.
+*/
+int sensors_poll_context_t::routeFusionSamples(sensors_event_t *data, int count) {
+	const int first = FUSION_SOURCE_HANDLE(SENSORS_PROXIMITY_HANDLE);
+	int kept = 0;
+
+	for (int i = 0; i < count; i++) {
+		int source = data[i].sensor - first;
+		if (source >= 0 && source < MAX_SRF02_SENSORS) {
+			if (mNearest) {
+				mNearest->addSample(source, data[i]);
+			}
+			continue;
+		}
+		if (kept != i) {
+			data[kept] = data[i];
+		}
+		kept++;
+	}
+	if (mNearest && mNearest->hasPendingEvents()) {
+		markReady(mNearestIndex);
+	}
+	return kept;
+}
+
 int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
-	//at the moment my driver is not able to change delay
-	int index = handleToDriver(handle);
-	if (index < 0) {
-		return index;
+	if (handleToDriver(handle) < 0 || ns < 0) {
+		return -EINVAL;
 	}
-	return mSensor[index]->setDelay(handle, ns);
+	pthread_mutex_lock(&mDirectLock);
+	mFrameworkPeriod[handle] = ns;
+	int err = applyPeriod(handle);
+	pthread_mutex_unlock(&mDirectLock);
+	return err;
 }
 
-int sensors_poll_context_t::pollEvents(sensors_event_t *data, int count) {
+/*
+* Programs the shortest period any client of the handle asked for, never below sMinPeriodUs of
+* the handle, the srf02 driver rejects periods below its ranging time. Nothing is programmed
+* without a client that asked for one. Caller holds mDirectLock.
+*/
+int sensors_poll_context_t::applyPeriod(int handle) {
+	int64_t period = mFrameworkActive[handle] ? mFrameworkPeriod[handle] : -1;
+
+	for (int c = 0; c < MAX_DIRECT_CHANNELS; c++) {
+		int64_t requested = mDirectPeriod[c][handle];
+		if (requested && (period < 0 || requested < period)) {
+			period = requested;
+		}
+	}
+	if (period < 0) {
+		return 0;
+	}
+	if (period < sMinPeriodUs[handle] * 1000LL) {
+		period = sMinPeriodUs[handle] * 1000LL;
+	}
+	return mSensor[handleToDriver(handle)]->setDelay(handle, period);
+}
+
+/*
+* Only drivers epoll reported ready (or woken by activate) are read, so the cost
+* per event does not depend on the number of drivers. Drivers are read through the
+* Registry, which calls the readEvents() of their kind without the vtable.
+*/
+int sensors_poll_context_t::pollDrivers(sensors_event_t *data, int count) {
+	struct epoll_event events [MAX_SENSOR_DRIVERS + 2];
 	int nbEvents = 0;
 	int n = 0;
-	int nb, polltime = -1;
 
 	do {
-		for (int i = 0; count && i < numSensorDrivers; i++) {
+		for (int r = 0; count && r < mNumReady; ) {
+			int i = mReady[r];
 			SensorBase* const sensor(mSensor[i]);
 
-			if (1) {
+			int nb = Registry::readEvents(mKind[i], sensor, data, count);
+			if (nb < 0) {
+				ALOGE ("sensor in sensors pollDrivers: readEvents failed (%s)", strerror(-nb));
 				nb = 0;
+			}
+			bool drained = nb < count && !Registry::hasPendingEvents(mKind[i], sensor);
+			if (mNearest && i != mNearestIndex) {
+				nb = routeFusionSamples(data, nb);
+			}
+			nb = routeDirectSamples(data, nb);
+			count -= nb;
+			nbEvents += nb;
+			data += nb;
+			// fd is -1 while the device is unplugged
+			updateDriverFd(i, false);
 
-				nb = sensor->readEvents(data, count);
-				if (nb < count) {
-					mPollFds[i].revents = 0;
-				}
-				count -= nb;
-				nbEvents += nb;
-				data += nb;
+			if (drained) {
+				// epoll is level triggered, anything left in the kernel reports again
+				mIsReady[i] = false;
+				mReady[r] = mReady[--mNumReady];
+			}
+			else {
+				r++;
+			}
+		}
+
+		if (count && mInitialPending) {
+			int nb = emitInitialEvents(data, count);
+			count -= nb;
+			nbEvents += nb;
+			data += nb;
+		}
 
-				ALOGI_IF (0, "sensors:readEvents() - nb=%d, count=%d, nbEvents=%d, data->timestamp=%lld, data->data[0]=%f, ", nb, count, nbEvents, data->timestamp, data->data[0]);
+		for (int h = 0; count && mNumFlushPending && h < MAX_HANDLES; h++) {
+			while (count && mFlushPending[h]) {
+				memset (data, 0, sizeof(*data));
+				data->version = META_DATA_VERSION;
+				data->type = SENSOR_TYPE_META_DATA;
+				data->meta_data.what = META_DATA_FLUSH_COMPLETE;
+				data->meta_data.sensor = h;
+				mFlushPending[h]--;
+				mNumFlushPending--;
+				count--;
+				nbEvents++;
+				data++;
 			}
 		}
+
 		if (count) {
 			do {
-				n = poll(mPollFds, numFds, nbEvents ? 0 : polltime);
+				n = epoll_wait(mEpollFd, events, ARRAY_SIZE(events), nbEvents ? 0 : -1);
 			} 
 			while (n < 0 && errno == EINTR);
 
 			if (n < 0) {
-				return -errno;
+				return nbEvents ? nbEvents : -errno;
 			}
-			if (mPollFds[wake].revents & (POLLIN | POLLPRI)) {
-				char msg;
-				int result = read(mPollFds[wake].fd, &msg, 1);
-				ALOGE_IF (result <0, "sensor in sensors poll Events : error reading frome wake pipe (%s)", strerror(errno));
-				ALOGE_IF (msg != WAKE_MESSAGE, "sensor in sensors poll Events : unknown message on wake queue (0x%02x)", int(msg));
-				mPollFds[wake].revents = 0;
+			for (int k = 0; k < n; k++) {
+				uint32_t token = events[k].data.u32;
+
+				if (token == TOKEN_HOTPLUG) {
+					handleHotplug();
+				}
+				else if (token == TOKEN_WAKE) {
+					handleWake();
+				}
+				else if (token < (uint32_t) mNumSensors) {
+					markReady(token);
+				}
 			}
 		}
 
 	} 
-	while (n && count);
+	while (n && count && !mQuit);
 
 	return nbEvents;
 }
 
+void *sensors_poll_context_t::engineLoop(void *arg) {
+	static_cast<sensors_poll_context_t *>(arg)->runEngine();
+	return NULL;
+}
+
+/*
+* Reads the drivers on a thread of the HAL, so direct channels are fed whether sensorservice
+* polls or not. Events for the framework are queued for pollEvents(). A full queue holds the
+* drivers back like in ThreadedSensor, unless direct channels still need their samples, then
+* the framework loses the events that do not fit.
+*/
+void sensors_poll_context_t::runEngine() {
+	sensors_event_t buffer [ENGINE_BATCH_EVENTS];
+
+	if (setpriority(PRIO_PROCESS, gettid(), ENGINE_THREAD_PRIORITY) < 0) {
+		ALOGW ("sensor in sensors runEngine: couldn't raise engine thread priority (%s)", strerror(errno));
+	}
+	while (!mQuit) {
+		size_t space = ARRAY_SIZE(buffer);
+		if (!android_atomic_acquire_load(&mNumDirectReports)) {
+			space = mEngineRing.space();
+			if (!space) {
+				usleep (ENGINE_RING_FULL_RETRY_MS * 1000);
+				continue;
+			}
+			if (space > ARRAY_SIZE(buffer)) {
+				space = ARRAY_SIZE(buffer);
+			}
+		}
+		int nb = pollDrivers(buffer, space);
+		if (nb < 0) {
+			ALOGE ("sensor in sensors runEngine: polling the drivers failed (%s)", strerror(-nb));
+			usleep (ENGINE_RING_FULL_RETRY_MS * 1000);
+			continue;
+		}
+		size_t written = mEngineRing.write(buffer, nb);
+		ALOGW_IF (written < (size_t) nb, "sensor in sensors runEngine: framework lost %d events", nb - (int) written);
+		if (written) {
+			char c = 0;
+			// EAGAIN means the pipe is readable anyway
+			write(mEngineNotifyFds[1], &c, 1);
+		}
+	}
+}
+
+/*
+* poll() of the framework only waits for the engine thread.
+*/
+int sensors_poll_context_t::pollEvents(sensors_event_t *data, int count) {
+	for (;;) {
+		char buf [64];
+
+		// drain first, events queued afterwards write a new notification
+		while (read(mEngineNotifyFds[0], buf, sizeof(buf)) > 0) {
+		}
+		int n = mEngineRing.read(data, count);
+		if (n) {
+			return n;
+		}
+		struct pollfd fds;
+		fds.fd = mEngineNotifyFds[0];
+		fds.events = POLLIN;
+		fds.revents = 0;
+		if (poll(&fds, 1, -1) < 0 && errno != EINTR) {
+			return -errno;
+		}
+	}
+}
+
+/*
+* Drain inotify and let the drivers reopen their input devices if needed.
+*/
+void sensors_poll_context_t::handleHotplug() {
+	char buf [512];
+
+	while (read(mHotplugFd, buf, sizeof(buf)) > 0) {
+		// only the fact that /dev/input changed matters
+	}
+	SensorBase::invalidateInputIndex();
+	for (int i = 0; i < mNumSensors; i++) {
+		if (mSensor[i]->handleHotplug()) {
+			// a reopened device may get the number of the old fd back
+			updateDriverFd(i, true);
+		}
+	}
+}
+
+/*
+* Without a hardware FIFO timeout can only be 0, events are always reported right away.
+* Since API 1.1 the sampling period is set here instead of setDelay().
+*/
 int sensors_poll_context_t::batch(int handle, int flags, int64_t period_ns, int64_t timeout) {
-	return 0;
+	int index = handleToDriver(handle);
+	if (index < 0) {
+		return index;
+	}
+	if (flags & SENSORS_BATCH_DRY_RUN) {
+		return 0;
+	}
+	return setDelay(handle, period_ns);
+}
+
+/*
+* Hands out the channel handles 1 .. MAX_DIRECT_CHANNELS, mem == NULL unregisters.
+*/
+int sensors_poll_context_t::registerDirectChannel(const sensors_direct_mem_t *mem, int channel) {
+	if (!mem) {
+		if (channel < 1 || channel > MAX_DIRECT_CHANNELS) {
+			return -EINVAL;
+		}
+		pthread_mutex_lock(&mDirectLock);
+		for (int h = 0; h < MAX_HANDLES; h++) {
+			stopDirectReport(channel - 1, h);
+		}
+		delete mDirect[channel - 1];
+		mDirect[channel - 1] = NULL;
+		pthread_mutex_unlock(&mDirectLock);
+		return 0;
+	}
+	if (mem->type != SENSOR_DIRECT_MEM_TYPE_ASHMEM || mem->format != SENSOR_DIRECT_FMT_SENSORS_EVENT
+			|| !mem->handle || mem->handle->numFds < 1) {
+		return -EINVAL;
+	}
+	DirectChannel *direct = new DirectChannel(mem->handle->data[0], mem->size);
+	if (!direct->isValid()) {
+		delete direct;
+		return -ENOMEM;
+	}
+
+	pthread_mutex_lock(&mDirectLock);
+	int result = -ENOSPC;
+	for (int i = 0; i < MAX_DIRECT_CHANNELS; i++) {
+		if (!mDirect[i]) {
+			mDirect[i] = direct;
+			result = i + 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mDirectLock);
+	if (result < 0) {
+		delete direct;
+	}
+	return result;
+}
+
+/*
+* Caller holds mDirectLock.
+*/
+void sensors_poll_context_t::stopDirectReport(int channel, int handle) {
+	if (!mDirectPeriod[channel][handle]) {
+		return;
+	}
+	mDirectPeriod[channel][handle] = 0;
+	mDirectReports[handle]--;
+	android_atomic_dec(&mNumDirectReports);
+	if (!mFrameworkActive[handle] && !mDirectReports[handle]) {
+		enableHandle(handle, 0);
+	}
+	else {
+		// back to the periods of the remaining clients
+		applyPeriod(handle);
+	}
+}
+
+/*
+* The report token is the handle + 1, handle 0 is a valid sensor. Rate levels above the one
+* in the flags of the sensor_t are rejected.
+*/
+int sensors_poll_context_t::configDirectReport(int handle, int channel, const sensors_direct_cfg_t *config) {
+	static const int64_t ratePeriod[] = { 0, 20000000LL, 5000000LL, 1250000LL };
+
+	if (!config || config->rate_level < SENSOR_DIRECT_RATE_STOP
+			|| config->rate_level > SENSOR_DIRECT_RATE_VERY_FAST
+			|| channel < 1 || channel > MAX_DIRECT_CHANNELS) {
+		return -EINVAL;
+	}
+	int64_t period = ratePeriod[config->rate_level];
+	const struct sensor_t *sensor = handle == -1 ? NULL : findSensor(handle);
+	int c = channel - 1;
+	int err = 0;
+
+	pthread_mutex_lock(&mDirectLock);
+	if (!mDirect[c]) {
+		err = -EINVAL;
+	}
+	else if (handle == -1) {
+		if (period) {
+			err = -EINVAL;
+		}
+		for (int h = 0; !err && h < MAX_HANDLES; h++) {
+			stopDirectReport(c, h);
+		}
+	}
+	else if (!sensor || config->rate_level > directRateLevel(sensor)) {
+		err = -EINVAL;
+	}
+	else if (!period) {
+		stopDirectReport(c, handle);
+	}
+	else {
+		int64_t previous = mDirectPeriod[c][handle];
+		bool running = mFrameworkActive[handle] || mDirectReports[handle];
+
+		if (!previous && !running) {
+			err = enableHandle(handle, 1);
+		}
+		if (!err && !previous) {
+			mDirectReports[handle]++;
+			android_atomic_inc(&mNumDirectReports);
+			mDirectLast[c][handle] = 0;
+		}
+		if (!err) {
+			mDirectPeriod[c][handle] = period;
+			err = applyPeriod(handle);
+		}
+		if (err >= 0 && !previous && running && mHasLastEvent[handle] && isOnChange(handle)) {
+			// the driver sent its initial event to the clients before us
+			mDirect[c]->write(mLastEvent[handle], handle + 1);
+			mDirectLast[c][handle] = mLastEvent[handle].timestamp;
+		}
+		if (err < 0 && previous) {
+			mDirectPeriod[c][handle] = previous;
+			applyPeriod(handle);
+		}
+		else if (err < 0) {
+			stopDirectReport(c, handle);
+		}
+	}
+	pthread_mutex_unlock(&mDirectLock);
+
+	if (err < 0) {
+		return err;
+	}
+	return handle < 0 || !period ? 0 : handle + 1;
 }
 
+/*
+* Copy the samples of handles with direct reports into their channels. They are only
+* returned to the framework if it activated them too. Returns the number of events left in data.
+* Also keeps the last event of every handle for clients that join later.
+*/
+int sensors_poll_context_t::routeDirectSamples(sensors_event_t *data, int count) {
+	int kept = 0;
+
+	pthread_mutex_lock(&mDirectLock);
+	for (int i = 0; i < count; i++) {
+		int h = data[i].sensor;
+
+		if (h >= 0 && h < MAX_HANDLES) {
+			mLastEvent[h] = data[i];
+			mHasLastEvent[h] = true;
+			// a new event is as good as the initial one
+			mFrameworkInitial[h] = false;
+		}
+		if (h >= 0 && h < MAX_HANDLES && mDirectReports[h]) {
+			for (int c = 0; c < MAX_DIRECT_CHANNELS; c++) {
+				int64_t period = mDirectPeriod[c][h];
+				// within the rate level, twice as fast is still allowed
+				if (period && data[i].timestamp - mDirectLast[c][h] >= period / 2) {
+					mDirect[c]->write(data[i], h + 1);
+					mDirectLast[c][h] = data[i].timestamp;
+				}
+			}
+			if (!mFrameworkActive[h]) {
+				continue;
+			}
+		}
+		if (kept != i) {
+			data[kept] = data[i];
+		}
+		kept++;
+	}
+	pthread_mutex_unlock(&mDirectLock);
+	return kept;
+}
+
+/*
+* The initial events of a framework that activated a handle already running for direct channels.
+*/
+int sensors_poll_context_t::emitInitialEvents(sensors_event_t *data, int count) {
+	int nb = 0;
+
+	pthread_mutex_lock(&mDirectLock);
+	mInitialPending = false;
+	for (int h = 0; h < MAX_HANDLES; h++) {
+		if (!mFrameworkInitial[h]) {
+			continue;
+		}
+		if (nb == count) {
+			// the rest goes out with the next poll
+			mInitialPending = true;
+			break;
+		}
+		mFrameworkInitial[h] = false;
+		// none yet, the first event of the driver follows anyway
+		if (mFrameworkActive[h] && mHasLastEvent[h]) {
+			data[nb++] = mLastEvent[h];
+		}
+	}
+	pthread_mutex_unlock(&mDirectLock);
+	return nb;
+}
+
+/*
+* There is no hardware FIFO, so flush completes as soon as the engine thread sees it.
+*/
 int sensors_poll_context_t::flush(int handle) {
+	int index = handleToDriver(handle);
+	if (index < 0) {
+		return index;
+	}
+	if (!mSensor[index]->getEnable(handle)) {
+		return -EINVAL;
+	}
+	wake(WAKE_FLUSH, handle);
 	return 0;
 }
 
@@ -263,20 +1357,35 @@ static int poll__flush (struct sensors_poll_device_1 *dev, int handle) {
 	return ctx->flush(handle);
 }
 
+static int poll__register_direct_channel (struct sensors_poll_device_1 *dev,
+		const struct sensors_direct_mem_t *mem, int channel_handle) {
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->registerDirectChannel(mem, channel_handle);
+}
+
+static int poll__config_direct_report (struct sensors_poll_device_1 *dev,
+		int sensor_handle, int channel_handle, const struct sensors_direct_cfg_t *config) {
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->configDirectReport(sensor_handle, channel_handle, config);
+}
+
 
 static int open_sensors (const struct hw_module_t* module, const char* id, struct hw_device_t** device) {
 	int status = -EINVAL;
+
+	initSensorList();
 	sensors_poll_context_t *dev = new sensors_poll_context_t();
 
 	if (!dev->isValid()) {
 		ALOGE ("Failed to open the sensors");
+		delete dev;
 		return status;
 	}
 
 	memset (&dev->device, 0, sizeof (sensors_poll_device_1));
 
 	dev->device.common.tag = HARDWARE_DEVICE_TAG;
-	dev->device.common.version = SENSORS_DEVICE_API_VERSION_1_0;
+	dev->device.common.version = SENSORS_DEVICE_API_VERSION;
 	dev->device.common.module = const_cast<hw_module_t*>(module);
 	dev->device.common.close = poll__close;
 	dev->device.activate = poll__activate;
@@ -286,6 +1395,12 @@ static int open_sensors (const struct hw_module_t* module, const char* id, struc
   	dev->device.batch = poll__batch;
     	dev->device.flush = poll__flush;
 
+	// direct report extension, see sensors_direct.h
+	sensors_register_direct_channel_t registerDirect = poll__register_direct_channel;
+	sensors_config_direct_report_t configDirect = poll__config_direct_report;
+	dev->device.reserved_procs[SENSORS_DIRECT_PROC_REGISTER] = (void (*)(void)) registerDirect;
+	dev->device.reserved_procs[SENSORS_DIRECT_PROC_CONFIG] = (void (*)(void)) configDirect;
+
 	*device = &dev->device.common;
 	status = 0;
 
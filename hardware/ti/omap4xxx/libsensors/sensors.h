@@ -26,12 +26,16 @@
 #include <linux/input.h>
 
 #include <hardware/hardware.h>
+#include <hardware/sensors.h>
 #include <../../../akm/AK8975_FS/libsensors/sensors.h>
 
 __BEGIN_DECLS
 
 
-#define I2C 	"/sys/bus/i2c/devices/i2c-4/4-0070/"
+// every i2c client bound to the srf02 kernel driver shows up here
+#define SRF02_DRIVER_DIR	"/sys/bus/i2c/drivers/srf02/"
+#define SRF02_INPUT_NAME	"SRF02 input event module"
+#define MAX_SRF02_SENSORS	(8)
 #define PROXIMITY_DATA "SRF02 proximity sensor"
 #define INPUT_EVENT_DEBUG (0)
 #define DEBUG (0)
@@ -41,9 +45,38 @@ __BEGIN_DECLS
 #define ARRAY_SIZE(a) (sizeof (a) / sizeof(a[0]))
 #endif
 
+#ifdef SENSORS_DEVICE_API_VERSION_1_3
+// every srf02 is listed as wake-up and as non-wake-up sensor
+#define SENSOR_VARIANTS	(2)
+#else
+#define SENSOR_VARIANTS	(1)
+#endif
+
+// srf02 sensors get the handles ID_PX, ID_PX + 1, ... in the order of their i2c names,
+// their non-wake-up variants the same handles shifted by MAX_SRF02_SENSORS,
 enum {
 	ID_PX
 };
+#define NON_WAKE_UP_HANDLE(handle)	((handle) + MAX_SRF02_SENSORS)
+// and their binary near/far outputs shifted by 2 * MAX_SRF02_SENSORS
+#define NEAR_FAR_HANDLE(handle)	((handle) + 2 * MAX_SRF02_SENSORS)
+// internal, never listed: every sample of a srf02 for the nearest obstacle sensor
+#define FUSION_SOURCE_HANDLE(handle)	((handle) + 3 * MAX_SRF02_SENSORS)
+// distance of a fusion source event for a failed measurement
+#define FUSION_SOURCE_FAILED	(-1.0f)
+#define ID_NEAREST_OBSTACLE	(ID_PX + 4 * MAX_SRF02_SENSORS)
+// AK8975 compass, if akmd runs on the board
+#define ID_AKM_MAGNETIC	(ID_NEAREST_OBSTACLE + 1)
+#define ID_AKM_ORIENTATION	(ID_NEAREST_OBSTACLE + 2)
+#define MAX_HANDLE	ID_AKM_ORIENTATION
+
+#ifndef SENSOR_TYPE_DEVICE_PRIVATE_BASE
+#define SENSOR_TYPE_DEVICE_PRIVATE_BASE	0x10000
+#endif
+// data[0] nearest distance in cm, data[1] index of the srf02, data[2] age of the freshest sample in ms
+#define SENSOR_TYPE_NEAREST_OBSTACLE	(SENSOR_TYPE_DEVICE_PRIVATE_BASE + 1)
+// API 1.3 wants a reverse domain name for private types
+#define SENSOR_STRING_TYPE_NEAREST_OBSTACLE	"com.srf02.sensor.nearest_obstacle"
 
 
 __END_DECLS
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_DIRECT_H_
+#define SENSORS_DIRECT_H_
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <cutils/native_handle.h>
+#include <hardware/sensors.h>
+
+__BEGIN_DECLS
+
+
+/*
+* Direct report channel, the model of the Android O sensors HAL on this device API 1.x HAL.
+* A client registers shared memory (ashmem or memfd) and picks a rate per sensor. The poll
+* thread writes every sample of those sensors as sensors_event_t into a ring in that memory,
+* event.sensor is the report token returned by config_direct_report() and event.reserved0
+* an atomic counter: 1, 2, ... skipping 0 on wrap, written last. A slot is valid once its
+* counter is the one expected next, the ring wraps after size / sizeof(sensors_event_t) events.
+*
+* The entry points sit in the reserved_procs of sensors_poll_device_1 at the place O put
+* register_direct_channel() and config_direct_report():
+*
+*	sensors_register_direct_channel_t reg = (sensors_register_direct_channel_t)
+*			dev->reserved_procs[SENSORS_DIRECT_PROC_REGISTER];
+*/
+#define SENSORS_DIRECT_PROC_REGISTER	(1)
+#define SENSORS_DIRECT_PROC_CONFIG	(2)
+
+// platforms before O do not know the types
+#ifndef SENSOR_DIRECT_MEM_TYPE_ASHMEM
+#define SENSOR_DIRECT_MEM_TYPE_ASHMEM	(1)
+#define SENSOR_DIRECT_FMT_SENSORS_EVENT	(1)
+
+#define SENSOR_DIRECT_RATE_STOP	(0)
+#define SENSOR_DIRECT_RATE_NORMAL	(1)	// nominal 50 Hz
+#define SENSOR_DIRECT_RATE_FAST	(2)	// nominal 200 Hz
+#define SENSOR_DIRECT_RATE_VERY_FAST	(3)	// nominal 800 Hz
+
+// sensor_t.flags of API 1.3, highest rate level and the supported memory types
+#define SENSOR_FLAG_SHIFT_DIRECT_REPORT	(7)
+#define SENSOR_FLAG_MASK_DIRECT_REPORT	(0x380)
+#define SENSOR_FLAG_DIRECT_CHANNEL_ASHMEM	(0x400)
+
+typedef struct sensors_direct_mem_t {
+	int type;	// SENSOR_DIRECT_MEM_TYPE_ASHMEM
+	int format;	// SENSOR_DIRECT_FMT_SENSORS_EVENT
+	size_t size;	// bytes
+	const native_handle_t *handle;	// data[0] is the fd
+} sensors_direct_mem_t;
+
+typedef struct sensors_direct_cfg_t {
+	int rate_level;
+} sensors_direct_cfg_t;
+#endif
+
+/*
+* mem != NULL registers a channel and returns its handle (> 0), mem == NULL unregisters
+* channel_handle and stops all its reports. The HAL keeps its own reference to the memory.
+*/
+typedef int (*sensors_register_direct_channel_t) (struct sensors_poll_device_1 *dev,
+		const struct sensors_direct_mem_t *mem, int channel_handle);
+
+/*
+* Starts, changes or stops (SENSOR_DIRECT_RATE_STOP) the report of sensor_handle into the
+* channel, returns the report token (> 0) or 0 after a stop. sensor_handle -1 stops all.
+*/
+typedef int (*sensors_config_direct_report_t) (struct sensors_poll_device_1 *dev,
+		int sensor_handle, int channel_handle, const struct sensors_direct_cfg_t *config);
+
+
+__END_DECLS
+
+#endif /* SENSORS_DIRECT_H_ */
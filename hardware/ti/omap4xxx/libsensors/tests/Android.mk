@@ -0,0 +1,19 @@
+LOCAL_PATH := $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libsensors_omap4_tests
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -DLOG_TAG=\"SensorsTest\"
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+LOCAL_SRC_FILES := \
+	../SensorBase.cpp \
+	../InputEventReader.cpp \
+	../AlphaBetaFilter.cpp \
+	../NearestObstacleSensor.cpp \
+	../proximity_sensor.cpp \
+	NearestObstacleSensor_test.cpp
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015 Anna-Lena Marx
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "proximity_sensor.h"
+#include "NearestObstacleSensor.h"
+
+namespace {
+
+/* ProximitySensor without hardware, ranging starts and stops without a kernel driver. */
+class FakeProximitySensor : public ProximitySensor {
+public:
+    FakeProximitySensor(int handle) : ProximitySensor(handle) {}
+
+    virtual int enable(int32_t, int en) {
+        if (en && !mEnabled) {
+            setInitialState();
+        }
+        mEnabled = en ? 1 : 0;
+        return 0;
+    }
+};
+
+const int RAW = ID_PX;
+const int SOURCE = FUSION_SOURCE_HANDLE(ID_PX);
+
+/* Hands the fusion source samples to the nearest obstacle sensor like the poll context. */
+void route(NearestObstacleSensor& nearest, const sensors_event_t* events, int n) {
+    for (int i = 0; i < n; i++) {
+        if (events[i].sensor == SOURCE) {
+            nearest.addSample(0, events[i]);
+        }
+    }
+}
+
+TEST(NearestObstacleSensorTest, InitialEventIsNoSample) {
+    FakeProximitySensor proximity(RAW);
+    NearestObstacleSensor nearest(ID_NEAREST_OBSTACLE, 2);
+    sensors_event_t events[8];
+
+    ASSERT_EQ(0, nearest.setEnable(ID_NEAREST_OBSTACLE, 1));
+    ASSERT_EQ(0, proximity.setEnable(SOURCE, 1));
+    ASSERT_EQ(0, proximity.setEnable(RAW, 1));
+    ASSERT_TRUE(proximity.hasPendingEvents());
+
+    int n = proximity.readEvents(events, 8);
+    ASSERT_EQ(1, n);
+    EXPECT_EQ(RAW, events[0].sensor);
+
+    route(nearest, events, n);
+    EXPECT_FALSE(nearest.hasPendingEvents());
+    EXPECT_FALSE(proximity.hasPendingEvents());
+}
+
+TEST(NearestObstacleSensorTest, InitialEventWithSourceFirst) {
+    FakeProximitySensor proximity(RAW);
+    NearestObstacleSensor nearest(ID_NEAREST_OBSTACLE, 2);
+    sensors_event_t events[8];
+
+    // the wake-up output joins while the srf02 already ranges for the fusion
+    ASSERT_EQ(0, nearest.setEnable(ID_NEAREST_OBSTACLE, 1));
+    ASSERT_EQ(0, proximity.setEnable(SOURCE, 1));
+    EXPECT_FALSE(proximity.hasPendingEvents());
+    ASSERT_EQ(0, proximity.setEnable(RAW, 1));
+
+    int n = proximity.readEvents(events, 8);
+    route(nearest, events, n);
+    EXPECT_FALSE(nearest.hasPendingEvents());
+}
+
+sensors_event_t sample(int64_t timestamp, float distance) {
+    sensors_event_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.sensor = SOURCE;
+    event.timestamp = timestamp;
+    event.distance = distance;
+    return event;
+}
+
+TEST(NearestObstacleSensorTest, SilentSourceKeepsObstacle) {
+    NearestObstacleSensor nearest(ID_NEAREST_OBSTACLE, 2);
+    sensors_event_t event;
+
+    ASSERT_EQ(0, nearest.setEnable(ID_NEAREST_OBSTACLE, 1));
+    nearest.addSample(0, sample(1000000000LL, 50));
+    // evdev drops unchanged distances, source 0 stays silent for seconds
+    nearest.addSample(1, sample(5000000000LL, 80));
+
+    ASSERT_EQ(1, nearest.readEvents(&event, 1));
+    EXPECT_EQ(50, event.distance);
+    EXPECT_EQ(0, event.data[1]);
+}
+
+TEST(NearestObstacleSensorTest, FailureExpiresSource) {
+    NearestObstacleSensor nearest(ID_NEAREST_OBSTACLE, 2);
+    sensors_event_t event;
+
+    ASSERT_EQ(0, nearest.setEnable(ID_NEAREST_OBSTACLE, 1));
+    nearest.addSample(0, sample(1000000000LL, 50));
+    nearest.addSample(1, sample(1000000000LL, 80));
+    ASSERT_EQ(1, nearest.readEvents(&event, 1));
+    EXPECT_EQ(50, event.distance);
+
+    nearest.addSample(0, sample(2000000000LL, FUSION_SOURCE_FAILED));
+    ASSERT_EQ(1, nearest.readEvents(&event, 1));
+    EXPECT_EQ(80, event.distance);
+    EXPECT_EQ(1, event.data[1]);
+}
+
+} // namespace
@@ -25,6 +25,7 @@
 #include <linux/gpio.h>
 #include <linux/usb/otg.h>
 #include <linux/i2c/twl.h>
+#include <linux/i2c/srf02.h>
 #include <linux/regulator/machine.h>
 #include <linux/regulator/fixed.h>
 #include <linux/wl12xx.h>
@@ -368,9 +369,19 @@ static struct i2c_board_info __initdata panda_i2c_eeprom[] = {
 	},
 };
 
+static struct srf02_platform_data panda_srf02_front = {
+	.period_ms	= 100,
+	.unit		= SRF02_UNIT_CM,
+	.filter_window	= 3,
+	.group		= 1,
+	.label		= "front",
+	.gestures	= true,
+};
+
 static struct i2c_board_info __initdata panda_i2c_srf02[] = {
 	{
 		I2C_BOARD_INFO("srf02", 0x70),
+		.platform_data = &panda_srf02_front,
 	},
 };
 
@@ -31,14 +31,23 @@
 #include <linux/delay.h>
 #include <linux/proc_fs.h>
 #include <linux/input.h> //needed for /dev/input/event
-#include <linux/earlysuspend.h>  //needed for suspend
+#include <linux/pm.h>
+#include <linux/pm_runtime.h>  //needed for suspend
+#include <linux/version.h>
+#include <linux/regmap.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+#include <linux/math64.h>
+#include <linux/idr.h>
+#include <net/genetlink.h>
+#include <linux/i2c/srf02.h>
 
 #include "srf02.h"
 
 
 
 MODULE_LICENSE("GPL");
-MODULE_DESCRIPTION("Driver for range sensor / proximity sensor srf02");
+MODULE_DESCRIPTION("Driver for range sensors / proximity sensors srf02, srf08 and srf10");
 MODULE_AUTHOR("Anna-Lena Marx");
 
 
@@ -46,6 +55,44 @@ MODULE_AUTHOR("Anna-Lena Marx");
 #define DEVICE_NAME "srf02"
 #define BUFFER_SIZE 64
 
+/**
+ * Default time between the start of two cyclic measurements and idle time before the bus may be runtime suspended
+ */
+#define SRF02_DEFAULT_PERIOD_MS 100
+#define SRF02_AUTOSUSPEND_DELAY_MS 1000
+
+/**
+ * Error handling for one measurement: bus errors are retried at most SRF02_RETRY_BUDGET times and never
+ * later than SRF02_DEADLINE_SLACK_MS after the ranging should be complete. After SRF02_BACKOFF_THRESHOLD failed
+ * samples in a row the period is doubled per failure up to SRF02_MAX_BACKOFF_MS, every SRF02_RECOVERY_THRESHOLD
+ * failures the adapter is recovered.
+ */
+#define SRF02_DEADLINE_SLACK_MS 50
+#define SRF02_RANGING_OVERHEAD_MS 3
+
+/**
+ * Ranging time characterization at probe: number of test measurements and interval for polling the
+ * revision register, which reads 0xff (or is not acknowledged) while the sensor is ranging
+ */
+#define SRF02_CHARACTERIZE_RUNS 3
+#define SRF02_POLL_INTERVAL_US 500
+#define SRF02_RANGING_BUSY 0xff
+#define SRF02_RETRY_BUDGET 3
+#define SRF02_BACKOFF_THRESHOLD 2
+#define SRF02_MAX_BACKOFF_MS 5000
+#define SRF02_RECOVERY_THRESHOLD 4
+
+/**
+ * Gesture detection: an object closer than NEAR_MM, or closer than FAR_MM and coming closer faster than
+ * APPROACH_SPEED, is approaching. It is withdrawn when it is farther than FAR_MM again, or farther than
+ * NEAR_MM + HYSTERESIS_MM and moving away. A near phase shorter than WAVE_MS is a wave.
+ */
+#define SRF02_GESTURE_NEAR_MM 300
+#define SRF02_GESTURE_FAR_MM 600
+#define SRF02_GESTURE_HYSTERESIS_MM 50
+#define SRF02_GESTURE_APPROACH_SPEED 300	// mm/s
+#define SRF02_GESTURE_WAVE_MS 700
+
 /**
  * New way to initalize spinlocks
  */
@@ -56,25 +103,124 @@ static struct class *srf02_class = NULL;
 
 static struct i2c_client *srf02_client = NULL;
 
-struct srf02_priv {
-	struct i2c_client *client;
-	// android suspend
-#ifdef CONFIG_EARLYSUSPEND
-	struct early_suspend es_handler;
-#endif
+/**
+ * Generic netlink family for sample fan-out. Group "samples" gets the samples of all sensors,
+ * group "sensor<id>" only those of one sensor.
+ */
+static struct genl_family srf02_genl_family = {
+		.id = GENL_ID_GENERATE,
+		.hdrsize = 0,
+		.name = SRF02_GENL_NAME,
+		.version = SRF02_GENL_VERSION,
+		.maxattr = SRF02_ATTR_MAX,
+};
+
+static struct genl_multicast_group srf02_genl_all = {
+		.name = SRF02_GENL_GROUP_ALL,
 };
 
+/**
+ * Sensor ids for netlink records and groups
+ */
+static DEFINE_IDA (srf02_ida);
+
+/**
+ * One lock per schedule group, sensors of a group take turns so they can not hear each others ping
+ */
+static struct mutex srf02_group_lock[SRF02_MAX_GROUPS];
 
 /**
- * For getting events in /dev/input/event*
+ * Commands and names for the units of srf02_platform_data
  */
-static struct input_dev *srf02_input_dev;
+static const u8 srf02_unit_cmd[] = {
+		[SRF02_UNIT_CM] = CMD_RESULT_IN_CM,
+		[SRF02_UNIT_INCH] = CMD_RESULT_IN_INCHES,
+		[SRF02_UNIT_US] = CMD_RESULT_IN_MS,
+};
+
+static const char * const srf02_unit_name[] = {
+		[SRF02_UNIT_CM] = "cm",
+		[SRF02_UNIT_INCH] = "inch",
+		[SRF02_UNIT_US] = "us",
+};
 
 /**
- * Important to use right adress of sensor here, if not, the srf02_i2c_probe() function will not be called
+ * Descriptors of the supported sensors. All of them share the srf02 register layout, srf08 and srf10
+ * additionally have a gain and a max range register. The ranging time of those shrinks with the max range.
+ */
+static const struct srf02_variant srf02_variants[] = {
+		[SRF02] = {
+			.name = "srf02",
+			.min_range_cm = 15,
+			.max_range_mm = 6000,
+			.ranging_time_ms = 70,
+			.max_register = CMD_MIN_RANGE_LOW_BYTE,
+		},
+		[SRF08] = {
+			.name = "srf08",
+			.min_range_cm = 3,
+			.max_range_mm = SRF08_MAX_RANGE_MM,
+			.max_gain = 31,
+			.has_gain = true,
+			.has_max_range = true,
+			.max_register = CMD_LAST_ECHO_LOW_BYTE,
+		},
+		[SRF10] = {
+			.name = "srf10",
+			.min_range_cm = 3,
+			.max_range_mm = SRF08_MAX_RANGE_MM,
+			.max_gain = 16,
+			.has_gain = true,
+			.has_max_range = true,
+			.max_register = CMD_RANGE_LOW_BYTE,
+		},
+};
+
+/**
+ * Per sensor state. Workqueue and work item are allocated once in probe and live until remove.
+ */
+struct srf02_priv {
+	struct i2c_client *client;
+	const struct srf02_variant *variant;
+	struct regmap *regmap;
+	struct input_dev *input_dev;	// for getting events in /dev/input/event*
+	struct workqueue_struct *wq;
+	struct delayed_work work;
+	struct mutex lock;		// serialises enable, period, range settings and suspend / resume
+	struct mutex bus_lock;		// serialises command / result sequences, taken before the group lock
+	s32 value_nonstop;		// last cyclic value, -1 if disabled
+	unsigned int period_ms;
+	unsigned int max_range_mm;
+	unsigned int gain;
+	unsigned int ranging_time_ms;	// time until a measurement is complete, follows max_range_mm
+	unsigned int ranging_overhead_us;	// ranging time beyond the sound round trip, measured at probe
+	unsigned int measured_ranging_us;	// worst ranging time measured at probe, 0 if unknown
+	bool enabled;
+	bool resume_enabled;		// enabled state saved over system suspend
+	unsigned int failures;		// failed samples in a row
+	unsigned int sequence;		// sample counter, sent as MSC_SERIAL
+	enum srf02_unit unit;
+	unsigned int group;		// schedule group, 0 for none
+	const char *label;
+	unsigned int filter_window;	// median filter length, 1 for no filtering
+	unsigned int filter_count;
+	unsigned int filter_pos;
+	int filter_buf[SRF02_MAX_FILTER_WINDOW];
+	struct input_dev *gesture_dev;	// high level events, silent while gestures are disabled
+	struct srf02_gesture gesture;
+	bool gestures_enabled;
+	int id;				// sensor id in netlink records
+	struct genl_multicast_group genl_group;
+};
+
+
+/**
+ * Important to use right name of sensor here, if not, the srf02_i2c_probe() function will not be called
  */
 static const struct i2c_device_id srf02_id [] = {
-		{"srf02", 0x70},
+		{"srf02", SRF02},
+		{"srf08", SRF08},
+		{"srf10", SRF10},
 		{},
 };
 
@@ -84,73 +230,525 @@ struct cdev *srf02dev;
 static int i_device_open = 0;
 static char command_buffer [BUFFER_SIZE];
 static int index_command_buffer;
-static struct device *dev_static;
 
 MODULE_DEVICE_TABLE (i2c, srf02_id);
 
+/**
+ * Addresses scanned by srf02_detect(). All sensors ship at 0x70, the others are reachable by changing the address.
+ */
+static const unsigned short srf02_address_list[] = {
+		0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, I2C_CLIENT_END
+};
+
+/**
+ * Writing to the bus while scanning is never done, still only adapters named here are scanned
+ */
+static int scan_bus[8];
+static int scan_bus_count;
+module_param_array (scan_bus, int, &scan_bus_count, 0444);
+MODULE_PARM_DESC (scan_bus, "numbers of the i2c adapters to scan for srf02 sensors");
+
+/**
+ * Register map of the srf02. Register 0 is the command register on write and the software revision on read,
+ * so it is volatile like the range registers. On srf08 / srf10 registers 1 and 2 are gain and max range on
+ * write but light sensor / range on read, so they are volatile as well. Only the unused register 1 of the
+ * srf02 (always 0x80) may be cached.
+ */
+static bool srf02_writeable_reg (struct device *dev, unsigned int reg) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	switch (reg) {
+		case CMD_COMMAND_REG:
+			return true;
+		case CMD_GAIN_REG:
+			return srf02_p->variant->has_gain;
+		case CMD_MAX_RANGE_REG:
+			return srf02_p->variant->has_max_range;
+		default:
+			return false;
+	}
+}
+
+static bool srf02_readable_reg (struct device *dev, unsigned int reg) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return reg <= srf02_p->variant->max_register;
+}
+
+static bool srf02_volatile_reg (struct device *dev, unsigned int reg) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return reg != CMD_UNUSED_REG || srf02_p->variant->has_gain;
+}
+
+static const struct regmap_config srf02_regmap_config = {
+		.reg_bits = 8,
+		.val_bits = 8,
+		.max_register = CMD_LAST_ECHO_LOW_BYTE,
+		.writeable_reg = srf02_writeable_reg,
+		.readable_reg = srf02_readable_reg,
+		.volatile_reg = srf02_volatile_reg,
+		.cache_type = REGCACHE_RBTREE,
+};
+
 static struct i2c_driver srf02_i2c_driver = {
 
+		.class = I2C_CLASS_HWMON,
 		.probe = srf02_i2c_probe,
 		.remove = __devexit_p (srf02_i2c_remove),
 		.id_table = srf02_id,
+		.detect = srf02_detect,
+		.address_list = srf02_address_list,
 		.driver = {
 				.name = "srf02",
 				.owner = THIS_MODULE,
+				.pm = &srf02_pm_ops,
 		},
 };
 
 
-s32 value_nonstop = -1;
 int active = 0;
 
 
 /**
- * Initalising workqueue for cyclic measurement if enabled
+ * Sensors of one group share the air, everything that makes one of them ping holds the group lock.
+ * The bus lock keeps the work item, sysfs reads and an address change of the same sensor from
+ * interleaving their transfers. It is not srf02_p->lock, that one is held while the work item is
+ * cancelled.
+ */
+static void srf02_lock_group (struct srf02_priv *srf02_p) {
+	mutex_lock (&srf02_p->bus_lock);
+	if (srf02_p->group) {
+		mutex_lock (&srf02_group_lock[srf02_p->group - 1]);
+	}
+}
+
+static void srf02_unlock_group (struct srf02_priv *srf02_p) {
+	if (srf02_p->group) {
+		mutex_unlock (&srf02_group_lock[srf02_p->group - 1]);
+	}
+	mutex_unlock (&srf02_p->bus_lock);
+}
+
+/**
+ * Run one measurement in cm. Failed bus transfers are retried within the retry budget, but never after
+ * the sample deadline, so a flaky sensor can not stall the caller. Returns the distance or a negative errno.
  */
-static void workq_fn (struct delayed_work *work);
+static int srf02_measure (struct srf02_priv *srf02_p) {
+	unsigned int ranging_time_ms = srf02_p->ranging_time_ms;
+	unsigned long deadline;
+	int attempts = SRF02_RETRY_BUDGET;
+	u8 range[2];
+	int ret;
+
+	// waiting for a peer of the group must not eat up the budget of this measurement
+	srf02_lock_group (srf02_p);
+	deadline = jiffies + msecs_to_jiffies (ranging_time_ms + SRF02_DEADLINE_SLACK_MS);
+
+	//Starting measurement in the configured unit
+	//write to command register in which unit the result shall be
+	do {
+		ret = regmap_write (srf02_p->regmap, CMD_COMMAND_REG, srf02_unit_cmd[srf02_p->unit]);
+	} while (ret < 0 && --attempts > 0 && time_before (jiffies, deadline));
+
+	if (ret < 0) {
+		goto exit_unlock;
+	}
+
+	//wait for result, msleep() is too coarse for the short ranging times of a reduced max range
+	if (ranging_time_ms < 20) {
+		usleep_range (ranging_time_ms * 1000, ranging_time_ms * 1000 + 1000);
+	}
+	else {
+		msleep (ranging_time_ms);
+	}
 
-static struct workqueue_struct *my_wq;
-typedef struct {
-	struct delayed_work my_work;
-}my_work_t;
-my_work_t *work;
+	//Reading result (high and low byte in one transfer), the srf02 does not acknowledge while it is still ranging
+	do {
+		ret = regmap_bulk_read (srf02_p->regmap, CMD_RANGE_HIGH_BYTE, range, sizeof (range));
+	} while (ret < 0 && --attempts > 0 && time_before (jiffies, deadline));
 
+	if (ret >= 0) {
+		ret = (range[0] * 256) + range[1];
+	}
+
+	exit_unlock:
+		srf02_unlock_group (srf02_p);
+		return ret;
+}
+
+static int srf02_cmp_int (const void *a, const void *b) {
+	return *(const int *) a - *(const int *) b;
+}
+
+/**
+ * Median over the last filter_window valid samples, suppresses single wrong echoes
+ */
+static int srf02_filter (struct srf02_priv *srf02_p, int value) {
+	int sorted[SRF02_MAX_FILTER_WINDOW];
+
+	if (srf02_p->filter_window <= 1) {
+		return value;
+	}
+
+	srf02_p->filter_buf[srf02_p->filter_pos] = value;
+	srf02_p->filter_pos = (srf02_p->filter_pos + 1) % srf02_p->filter_window;
+	if (srf02_p->filter_count < srf02_p->filter_window) {
+		srf02_p->filter_count++;
+	}
+
+	memcpy (sorted, srf02_p->filter_buf, srf02_p->filter_count * sizeof (int));
+	sort (sorted, srf02_p->filter_count, sizeof (int), srf02_cmp_int, NULL);
+	return sorted[srf02_p->filter_count / 2];
+}
+
+static void srf02_filter_reset (struct srf02_priv *srf02_p) {
+	srf02_p->filter_count = 0;
+	srf02_p->filter_pos = 0;
+}
+
+/**
+ * Convert a distance in the unit the sensor reports in to mm
+ */
+static int srf02_unit_to_mm (struct srf02_priv *srf02_p, int value) {
+	switch (srf02_p->unit) {
+		case SRF02_UNIT_INCH:
+			return value * 254 / 10;
+		case SRF02_UNIT_US:
+			return value * SPEED_OF_SOUND_MM_PER_MS / 2000;
+		default:
+			return value * 10;
+	}
+}
+
+/**
+ * Forget the history, reports withdrawn if an object was near. Called with srf02_p->lock held.
+ */
+static void srf02_gesture_reset (struct srf02_priv *srf02_p) {
+	struct srf02_gesture *gesture = &srf02_p->gesture;
+
+	if (gesture->near) {
+		input_report_switch (srf02_p->gesture_dev, SW_FRONT_PROXIMITY, 0);
+		input_sync (srf02_p->gesture_dev);
+	}
+	gesture->near = false;
+	gesture->has_last = false;
+	gesture->velocity = 0;
+}
+
+/**
+ * Gesture state machine, fed with every valid sample. Only transitions generate events:
+ * SW_FRONT_PROXIMITY 1 / 0 for approaching / withdrawn and a press of SRF02_KEY_WAVE for a wave.
+ */
+static void srf02_gesture_update (struct srf02_priv *srf02_p, int value) {
+	struct srf02_gesture *gesture = &srf02_p->gesture;
+	ktime_t now = ktime_get ();
+	int mm = srf02_unit_to_mm (srf02_p, value);
+	s64 dt_us;
+
+	if (!srf02_p->gestures_enabled) {
+		return;
+	}
+
+	// velocity in mm/s, averaged with the previous estimate to smooth jitter
+	if (gesture->has_last) {
+		dt_us = ktime_us_delta (now, gesture->last_time);
+		if (dt_us > 0) {
+			gesture->velocity = (gesture->velocity +
+					(int) div64_s64 ((s64) (mm - gesture->last_mm) * USEC_PER_SEC, dt_us)) / 2;
+		}
+	}
+	gesture->last_mm = mm;
+	gesture->last_time = now;
+	gesture->has_last = true;
+
+	if (!gesture->near) {
+		if (mm < SRF02_GESTURE_NEAR_MM ||
+				(mm < SRF02_GESTURE_FAR_MM && gesture->velocity < -SRF02_GESTURE_APPROACH_SPEED)) {
+			gesture->near = true;
+			gesture->near_since = now;
+			input_report_switch (srf02_p->gesture_dev, SW_FRONT_PROXIMITY, 1);
+			input_sync (srf02_p->gesture_dev);
+		}
+	}
+	else if (mm > SRF02_GESTURE_FAR_MM ||
+			(mm > SRF02_GESTURE_NEAR_MM + SRF02_GESTURE_HYSTERESIS_MM && gesture->velocity > 0)) {
+		gesture->near = false;
+		input_report_switch (srf02_p->gesture_dev, SW_FRONT_PROXIMITY, 0);
+		input_sync (srf02_p->gesture_dev);
+
+		if (ktime_us_delta (now, gesture->near_since) < SRF02_GESTURE_WAVE_MS * USEC_PER_MSEC) {
+			input_report_key (srf02_p->gesture_dev, SRF02_KEY_WAVE, 1);
+			input_sync (srf02_p->gesture_dev);
+			input_report_key (srf02_p->gesture_dev, SRF02_KEY_WAVE, 0);
+			input_sync (srf02_p->gesture_dev);
+		}
+	}
+}
+
+/**
+ * Try to get a stuck bus working again, e.g. if a slave holds SDA low after an aborted transfer
+ */
+static void srf02_recover_bus (struct i2c_client *client) {
+	int ret = -EOPNOTSUPP;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 10, 0)
+	ret = i2c_recover_bus (client->adapter);
+#endif
+	// without generic recovery the adapter driver resets its controller on timeouts by itself
+	printk (KERN_INFO "srf02 - bus recovery on adapter %d returned %d \n", client->adapter->nr, ret);
+}
+
+/**
+ * Delay until the next measurement, counted from the start of the last one. Backs off exponentially while
+ * the sensor keeps failing.
+ */
+static unsigned long srf02_next_delay (struct srf02_priv *srf02_p, unsigned long started) {
+	unsigned int delay_ms = srf02_p->period_ms;
+	unsigned long elapsed = jiffies - started;
+	unsigned int backoff;
+
+	if (srf02_p->failures >= SRF02_BACKOFF_THRESHOLD) {
+		backoff = srf02_p->failures - SRF02_BACKOFF_THRESHOLD + 1;
+		while (backoff-- && delay_ms < SRF02_MAX_BACKOFF_MS) {
+			delay_ms *= 2;
+		}
+		delay_ms = min (delay_ms, (unsigned int) SRF02_MAX_BACKOFF_MS);
+	}
+	if (msecs_to_jiffies (delay_ms) <= elapsed) {
+		return 0;
+	}
+	return msecs_to_jiffies (delay_ms) - elapsed;
+}
+
+/**
+ * Multicast one sample record to a netlink group, nothing is allocated if nobody listens
+ */
+static void srf02_genl_send (struct genl_multicast_group *group, const struct srf02_sample *sample) {
+	struct sk_buff *skb;
+	void *hdr;
+
+	if (!netlink_has_listeners (init_net.genl_sock, group->id)) {
+		return;
+	}
+
+	skb = genlmsg_new (nla_total_size (sizeof (*sample)), GFP_KERNEL);
+	if (!skb) {
+		return;
+	}
+	hdr = genlmsg_put (skb, 0, 0, &srf02_genl_family, 0, SRF02_CMD_SAMPLE);
+	if (!hdr || nla_put (skb, SRF02_ATTR_SAMPLE, sizeof (*sample), sample)) {
+		nlmsg_free (skb);
+		return;
+	}
+	genlmsg_end (skb, hdr);
+	genlmsg_multicast (skb, 0, group->id, GFP_KERNEL);
+}
+
+/**
+ * Publish a sample on netlink, to the group of all sensors and to the group of this sensor
+ */
+static void srf02_genl_publish (struct srf02_priv *srf02_p, int value, bool valid) {
+	struct srf02_sample sample = {
+		.sensor = srf02_p->id,
+		.value = value,
+		.flags = valid ? 0 : SRF02_SAMPLE_INVALID,
+		.unit = srf02_p->unit,
+		.timestamp_ns = ktime_to_ns (ktime_get ()),
+	};
+
+	srf02_genl_send (&srf02_genl_all, &sample);
+	srf02_genl_send (&srf02_p->genl_group, &sample);
+}
 
 /**
  * Function is called cyclic by kworker. Store measured value in value_nonstop if active.
+ * A failed measurement is reported as invalid sample (EV_MSC / MSC_RAW with the errno), ABS_DISTANCE is not touched.
+ * Every sample carries its number as EV_MSC / MSC_SERIAL. The input core drops an ABS_DISTANCE equal to the last
+ * one, without it a target that does not move would not make any event and look like a missing sample.
  */
-void workq_fn (struct delayed_work *work) {
+static void workq_fn (struct work_struct *work) {
 // Work Queue seens hating spinlocks
 
+	struct srf02_priv *srf02_p = container_of (to_delayed_work (work), struct srf02_priv, work);
+	struct i2c_client *client = srf02_p->client;
+	unsigned long started = jiffies;
+	int value;
 
-	int ret = 0;
-	s32 i2cRet = 0;
-	int value_reg1 = 0;
-	int value_reg2 = 0;
-
-	//atomic_long_set(&(workq->data),10);
-	//printk (KERN_INFO "srf02 - in workq-function \n");
 	//printk (KERN_INFO "srf02 - doing a cyclic measurement \n");
 
-	struct i2c_client *client = to_i2c_client(dev_static);
-	//Starting measurement in cm
-	//write to command register that result shall be in cm
-	i2cRet = i2c_smbus_write_byte_data (client, CMD_COMMAND_REG, CMD_RESULT_IN_CM);
+	value = srf02_measure (srf02_p);
 
-	msleep(100);
+	if (value >= 0) {
+		srf02_p->failures = 0;
+		value = srf02_filter (srf02_p, value);
+		srf02_p->value_nonstop = value;
+		input_event(srf02_p->input_dev, EV_ABS, ABS_DISTANCE, value);
+		srf02_gesture_update (srf02_p, value);
+		srf02_genl_publish (srf02_p, value, true);
+	}
+	else {
+		srf02_p->failures++;
+		printk (KERN_INFO "srf02 - measurement failed (%d), %u in a row \n", value, srf02_p->failures);
+		input_event(srf02_p->input_dev, EV_MSC, MSC_RAW, value);
+		srf02_genl_publish (srf02_p, value, false);
 
-	//Reading result
-	value_reg1 = i2c_smbus_read_byte_data (client, CMD_RANGE_HIGH_BYTE);
-	value_reg2 = i2c_smbus_read_byte_data (client, CMD_RANGE_LOW_BYTE);
+		if ((srf02_p->failures % SRF02_RECOVERY_THRESHOLD) == 0) {
+			srf02_recover_bus (client);
+		}
+	}
+	input_event(srf02_p->input_dev, EV_MSC, MSC_SERIAL, ++srf02_p->sequence);
+	input_sync(srf02_p->input_dev);
 
-	printk (KERN_INFO "srf02 - value is : %d \n", ((value_reg1 * 256) + value_reg2));
-	value_nonstop = (value_reg1 * 256) + value_reg2;
-	input_event(srf02_input_dev, EV_ABS, ABS_DISTANCE, value_nonstop);
-	input_sync(srf02_input_dev);
+	queue_delayed_work(srf02_p->wq, &srf02_p->work, srf02_next_delay (srf02_p, started));
+}
 
+/**
+ * Time the sound needs to travel to max range and back
+ */
+static unsigned int srf02_round_trip_us (unsigned int max_range_mm) {
+	return DIV_ROUND_UP (2 * max_range_mm * 1000, SPEED_OF_SOUND_MM_PER_MS);
+}
 
-	ret = queue_delayed_work(my_wq, (struct delayed_work *)work, msecs_to_jiffies(100));
+/**
+ * Convert a distance to the unit the sensor reports in
+ */
+static int srf02_mm_to_unit (struct srf02_priv *srf02_p, unsigned int mm) {
+	switch (srf02_p->unit) {
+		case SRF02_UNIT_INCH:
+			return mm * 10 / 254;
+		case SRF02_UNIT_US:
+			return srf02_round_trip_us (mm);
+		default:
+			return mm / 10;
+	}
+}
 
+/**
+ * Round max range up to the next step of the range register and limit it to the sensor
+ */
+static unsigned int srf02_clamp_max_range (const struct srf02_variant *variant, unsigned long max_range_mm) {
+	return clamp (roundup (max_range_mm, SRF08_RANGE_STEP_MM), (unsigned long) SRF08_RANGE_STEP_MM,
+			(unsigned long) variant->max_range_mm);
+}
+
+/**
+ * Time until a measurement is complete. Fixed for the srf02, for sensors with a max range register this is
+ * the round trip to max range plus the processing overhead of the sensor.
+ */
+static unsigned int srf02_ranging_time_ms (struct srf02_priv *srf02_p) {
+	const struct srf02_variant *variant = srf02_p->variant;
+
+	if (!variant->has_max_range) {
+		if (srf02_p->measured_ranging_us) {
+			return DIV_ROUND_UP (srf02_p->measured_ranging_us + SRF02_POLL_INTERVAL_US, 1000);
+		}
+		return variant->ranging_time_ms;
+	}
+	return DIV_ROUND_UP (srf02_round_trip_us (srf02_p->max_range_mm) + srf02_p->ranging_overhead_us, 1000);
+}
+
+/**
+ * Measure how long the sensor really needs for a measurement by polling the revision register until it
+ * is readable again. Keeps the worst of a few runs. Called from probe before sampling can be enabled.
+ */
+static int srf02_characterize (struct srf02_priv *srf02_p) {
+	unsigned int revision = SRF02_RANGING_BUSY;
+	unsigned long deadline;
+	unsigned int worst_us = 0;
+	ktime_t start;
+	int run;
+	int ret;
+
+	for (run = 0; run < SRF02_CHARACTERIZE_RUNS; run++) {
+		srf02_lock_group (srf02_p);
+		ret = regmap_write (srf02_p->regmap, CMD_COMMAND_REG, CMD_RESULT_IN_CM);
+		if (ret < 0) {
+			srf02_unlock_group (srf02_p);
+			return ret;
+		}
+		start = ktime_get ();
+		deadline = jiffies + msecs_to_jiffies (srf02_p->ranging_time_ms + SRF02_DEADLINE_SLACK_MS);
+
+		do {
+			usleep_range (SRF02_POLL_INTERVAL_US, SRF02_POLL_INTERVAL_US + 100);
+			ret = regmap_read (srf02_p->regmap, CMD_REVISION_REG, &revision);
+		} while ((ret < 0 || revision == SRF02_RANGING_BUSY) && time_before (jiffies, deadline));
+		srf02_unlock_group (srf02_p);
+
+		if (ret < 0 || revision == SRF02_RANGING_BUSY) {
+			return -ETIMEDOUT;
+		}
+		worst_us = max (worst_us, (unsigned int) ktime_us_delta (ktime_get (), start));
+	}
+
+	srf02_p->measured_ranging_us = worst_us;
+	if (srf02_p->variant->has_max_range) {
+		// one poll interval as margin, the sensor may have finished anywhere within the last one
+		ret = worst_us - srf02_round_trip_us (srf02_p->max_range_mm);
+		srf02_p->ranging_overhead_us = max (ret, 0) + SRF02_POLL_INTERVAL_US;
+	}
+	printk (KERN_INFO "srf02 - %s revision %u, ranging takes %u us \n", srf02_p->variant->name, revision, worst_us);
+	return 0;
+}
+
+/**
+ * Write gain and max range to the sensor (they are lost on power loss) and update the ranging deadline.
+ * The period is raised if it got shorter than a measurement. Called with srf02_p->lock held.
+ */
+static int srf02_apply_range_settings (struct srf02_priv *srf02_p) {
+	const struct srf02_variant *variant = srf02_p->variant;
+	int ret;
+
+	if (variant->has_gain) {
+		ret = regmap_write (srf02_p->regmap, CMD_GAIN_REG, srf02_p->gain);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	if (variant->has_max_range) {
+		ret = regmap_write (srf02_p->regmap, CMD_MAX_RANGE_REG, srf02_p->max_range_mm / SRF08_RANGE_STEP_MM - 1);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	srf02_p->ranging_time_ms = srf02_ranging_time_ms (srf02_p);
+	srf02_p->period_ms = max (srf02_p->period_ms, srf02_p->ranging_time_ms);
+	return 0;
+}
+
+/**
+ * Start cyclic measurement. Holds a runtime PM reference as long as sampling is enabled.
+ * Called with srf02_p->lock held.
+ */
+static void srf02_start_sampling (struct srf02_priv *srf02_p) {
+	if (srf02_p->enabled) {
+		return;
+	}
+	pm_runtime_get_sync (&srf02_p->client->dev);
+	srf02_p->enabled = true;
+	srf02_p->value_nonstop = 0;
+	srf02_p->failures = 0;
+	srf02_filter_reset (srf02_p);
+	srf02_gesture_reset (srf02_p);
+	queue_delayed_work (srf02_p->wq, &srf02_p->work, msecs_to_jiffies(srf02_p->period_ms));
+}
+
+/**
+ * Stop cyclic measurement and drop the runtime PM reference, so the bus may autosuspend.
+ * Called with srf02_p->lock held.
+ */
+static void srf02_stop_sampling (struct srf02_priv *srf02_p) {
+	if (!srf02_p->enabled) {
+		return;
+	}
+	cancel_delayed_work_sync (&srf02_p->work);
+	srf02_p->enabled = false;
+	srf02_p->value_nonstop = -1; // for disabling -
+	srf02_gesture_reset (srf02_p);
+	pm_runtime_mark_last_busy (&srf02_p->client->dev);
+	pm_runtime_put_autosuspend (&srf02_p->client->dev);
 }
 
 
@@ -160,15 +758,16 @@ void workq_fn (struct delayed_work *work) {
  */
 static ssize_t srf02_get_values_cyclic (struct device *dev, struct device_attribute *attr, char *buf) {
 	// write here value to sysfs if it is asked for -> value is in a variable which is updated nonstop
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
 
-	if (value_nonstop < 0) {
+	if (srf02_p->value_nonstop < 0) {
 		//printk (KERN_INFO "srf02 - nonstop measurement seems to be disabled \n");
 	}
 	else {
-		printk (KERN_INFO "srf02 - value is : %d (with work queue) \n", value_nonstop);
+		printk (KERN_INFO "srf02 - value is : %d (with work queue) \n", srf02_p->value_nonstop);
 	}
 
-	return sprintf (buf, "%d \n", value_nonstop);
+	return sprintf (buf, "%d \n", srf02_p->value_nonstop);
 }
 
 /**
@@ -176,41 +775,368 @@ static ssize_t srf02_get_values_cyclic (struct device *dev, struct device_attrib
  */
 static ssize_t srf02_store_values_cyclic (struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
 
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
 	unsigned long value;
-	int ret;
-
-	printk (KERN_INFO "srf02 - 1 for enabling nonstop measurement, 0 for disabling \n");
 
 	value = simple_strtoul (buf, NULL, 10);
 
+	mutex_lock (&srf02_p->lock);
 	//enable
 	if (value > 0) {
-		dev_static = dev; //to use dev in ueue function?
-
-		my_wq = create_workqueue("my_workqueue");
-		if (my_wq) {
-			work = (my_work_t *) kmalloc (sizeof (my_work_t), GFP_KERNEL);
-			if (work) {
-				INIT_DELAYED_WORK ((struct delayed_work *) work, workq_fn);
-				ret = queue_delayed_work(my_wq, (struct delayed_work *) work, msecs_to_jiffies(100));
-			}
-		}
-		value_nonstop = 0;
+		srf02_start_sampling (srf02_p);
+	}
+	else {
+		printk (KERN_INFO "srf02 - disabling cyclic measurement \n");
+		srf02_stop_sampling (srf02_p);
+	}
+	mutex_unlock (&srf02_p->lock);
+
+	return size;
+}
+
+//register in sysfs
+static DEVICE_ATTR (value_now, 0644, srf02_get_values_cyclic, srf02_store_values_cyclic);
+
+
+/**
+ * Show time between the start of two cyclic measurements in ms
+ */
+static ssize_t srf02_get_period (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%u\n", srf02_p->period_ms);
+}
+
+/**
+ * Set time between the start of two cyclic measurements in ms, takes effect with the next measurement.
+ * Has to be at least the ranging time.
+ */
+static ssize_t srf02_store_period (struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+	unsigned long value;
+	int ret = size;
+
+	value = simple_strtoul (buf, NULL, 10);
+
+	mutex_lock (&srf02_p->lock);
+	if (value < srf02_p->ranging_time_ms) {
+		ret = -EINVAL;
+	}
+	else {
+		srf02_p->period_ms = value;
+	}
+	mutex_unlock (&srf02_p->lock);
+
+	return ret;
+}
+
+static DEVICE_ATTR (period, 0644, srf02_get_period, srf02_store_period);
+
+
+/**
+ * Show ranging time measured at probe in us, 0 if it could not be measured
+ */
+static ssize_t srf02_get_ranging_time (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%u\n", srf02_p->measured_ranging_us);
+}
+
+static DEVICE_ATTR (ranging_time_us, 0444, srf02_get_ranging_time, NULL);
+
+
+/**
+ * Show shortest possible period in ms for the current max range
+ */
+static ssize_t srf02_get_min_period (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%u\n", srf02_p->ranging_time_ms);
+}
+
+static DEVICE_ATTR (min_period_ms, 0444, srf02_get_min_period, NULL);
+
+
+/**
+ * Show max range in mm (writeable on srf08 / srf10 only)
+ */
+static ssize_t srf02_get_max_range (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%u\n", srf02_p->max_range_mm);
+}
+
+/**
+ * Set max range in mm, rounded up to the next 43 mm step. Shortens the ranging time and so the minimum period.
+ */
+static ssize_t srf02_store_max_range (struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+	unsigned long value;
+	int ret;
+
+	value = srf02_clamp_max_range (srf02_p->variant, simple_strtoul (buf, NULL, 10));
+
+	mutex_lock (&srf02_p->lock);
+	srf02_p->max_range_mm = value;
+	ret = srf02_apply_range_settings (srf02_p);
+	mutex_unlock (&srf02_p->lock);
+
+	return ret < 0 ? ret : size;
+}
+
+static DEVICE_ATTR (max_range_mm, 0644, srf02_get_max_range, srf02_store_max_range);
+
+
+/**
+ * Show analogue gain (srf08 / srf10 only)
+ */
+static ssize_t srf02_get_gain (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%u\n", srf02_p->gain);
+}
+
+/**
+ * Set analogue gain, a lower gain avoids ghost echoes from previous pings when the max range is short
+ */
+static ssize_t srf02_store_gain (struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+	unsigned long value;
+	int ret;
+
+	value = simple_strtoul (buf, NULL, 10);
+	if (value > srf02_p->variant->max_gain) {
+		return -EINVAL;
+	}
+
+	mutex_lock (&srf02_p->lock);
+	srf02_p->gain = value;
+	ret = srf02_apply_range_settings (srf02_p);
+	mutex_unlock (&srf02_p->lock);
+
+	return ret < 0 ? ret : size;
+}
+
+static DEVICE_ATTR (gain, 0644, srf02_get_gain, srf02_store_gain);
+
+
+/**
+ * Show unit of the reported distance
+ */
+static ssize_t srf02_get_unit (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%s\n", srf02_unit_name[srf02_p->unit]);
+}
+
+static DEVICE_ATTR (unit, 0444, srf02_get_unit, NULL);
+
+
+/**
+ * Show mounting position from the board file
+ */
+static ssize_t srf02_get_label (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%s\n", srf02_p->label ? srf02_p->label : "");
+}
+
+static DEVICE_ATTR (label, 0444, srf02_get_label, NULL);
+
+
+/**
+ * Show schedule group, 0 if the sensor ranges independently
+ */
+static ssize_t srf02_get_group (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%u\n", srf02_p->group);
+}
+
+static DEVICE_ATTR (group, 0444, srf02_get_group, NULL);
+
+
+/**
+ * Show number of samples the median filter runs over
+ */
+static ssize_t srf02_get_filter_window (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%u\n", srf02_p->filter_window);
+}
+
+/**
+ * Set number of samples the median filter runs over, 1 disables filtering
+ */
+static ssize_t srf02_store_filter_window (struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+	unsigned long value;
+
+	value = simple_strtoul (buf, NULL, 10);
+	if (value < 1 || value > SRF02_MAX_FILTER_WINDOW) {
+		return -EINVAL;
+	}
+
+	mutex_lock (&srf02_p->lock);
+	// the work must not run the filter while it changes
+	cancel_delayed_work_sync (&srf02_p->work);
+	srf02_p->filter_window = value;
+	srf02_filter_reset (srf02_p);
+	if (srf02_p->enabled) {
+		queue_delayed_work (srf02_p->wq, &srf02_p->work, 0);
 	}
+	mutex_unlock (&srf02_p->lock);
+
+	return size;
+}
+
+static DEVICE_ATTR (filter_window, 0644, srf02_get_filter_window, srf02_store_filter_window);
+
+
+/**
+ * Show sensor id used in netlink records, its own netlink group is "sensor<id>"
+ */
+static ssize_t srf02_get_id (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%d\n", srf02_p->id);
+}
+
+static DEVICE_ATTR (id, 0444, srf02_get_id, NULL);
 
-	if (value == 0) {
-		printk (KERN_INFO "srf02 - disabling after flush_wq \n");
 
-		cancel_delayed_work((struct delayed_work *)work);
+/**
+ * Show whether gesture detection is enabled
+ */
+static ssize_t srf02_get_gestures (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+
+	return sprintf (buf, "%d\n", srf02_p->gestures_enabled);
+}
 
-		value_nonstop = -1; // for disabling -
+/**
+ * Writing 1 enables gesture events on the gesture input device, 0 disables them
+ */
+static ssize_t srf02_store_gestures (struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+	bool enable = simple_strtoul (buf, NULL, 10) > 0;
+
+	mutex_lock (&srf02_p->lock);
+	if (enable != srf02_p->gestures_enabled) {
+		// the work must not run the state machine while it changes
+		cancel_delayed_work_sync (&srf02_p->work);
+		srf02_gesture_reset (srf02_p);
+		srf02_p->gestures_enabled = enable;
+		if (srf02_p->enabled) {
+			queue_delayed_work (srf02_p->wq, &srf02_p->work, 0);
+		}
 	}
+	mutex_unlock (&srf02_p->lock);
 
 	return size;
 }
 
-//register in sysfs
-static DEVICE_ATTR (value_now, 0644, srf02_get_values_cyclic, srf02_store_values_cyclic);
+static DEVICE_ATTR (gestures, 0644, srf02_get_gestures, srf02_store_gestures);
+
+
+/**
+ * Show current 7 bit i2c address
+ */
+static ssize_t srf02_get_address (struct device *dev, struct device_attribute *attr, char *buf) {
+	struct i2c_client *client = to_i2c_client (dev);
+
+	return sprintf (buf, "0x%02x\n", client->addr);
+}
+
+/**
+ * Program a new i2c address into the sensor. The new address has to be free on the bus and sampling has
+ * to be disabled. Afterwards the sensor has to answer on the new address and must not answer on the old
+ * one any more. The client keeps its device name until the next boot, but all transfers use the new address.
+ */
+static int srf02_change_address (struct srf02_priv *srf02_p, unsigned long new_addr) {
+	static const u8 sequence[] = { CMD_CHANGE_ADDRESS_1, CMD_CHANGE_ADDRESS_2, CMD_CHANGE_ADDRESS_3 };
+	struct i2c_client *client = srf02_p->client;
+	struct i2c_client *probe;
+	s32 revision;
+	int i;
+	int ret;
+
+	if (new_addr < SRF02_FIRST_ADDRESS || new_addr > SRF02_LAST_ADDRESS) {
+		return -EINVAL;
+	}
+	if (new_addr == client->addr) {
+		return 0;
+	}
+
+	mutex_lock (&srf02_p->lock);
+	if (srf02_p->enabled) {
+		ret = -EBUSY;
+		goto exit_unlock;
+	}
+
+	// the new address must neither be used by another client nor answer on the bus
+	probe = i2c_new_dummy (client->adapter, new_addr);
+	if (!probe) {
+		ret = -EADDRINUSE;
+		goto exit_unlock;
+	}
+	if (i2c_smbus_read_byte_data (probe, CMD_REVISION_REG) >= 0) {
+		ret = -EADDRINUSE;
+		goto exit_unregister_probe;
+	}
+
+	pm_runtime_get_sync (&client->dev);
+	// no peer of the group may range while the sensor is between two addresses
+	srf02_lock_group (srf02_p);
+	for (i = 0; i < ARRAY_SIZE (sequence); i++) {
+		ret = regmap_write (srf02_p->regmap, CMD_COMMAND_REG, sequence[i]);
+		if (ret < 0) {
+			goto exit_put;
+		}
+	}
+	ret = regmap_write (srf02_p->regmap, CMD_COMMAND_REG, new_addr << 1);
+	if (ret < 0) {
+		goto exit_put;
+	}
+
+	// verify
+	revision = i2c_smbus_read_byte_data (probe, CMD_REVISION_REG);
+	if (revision < 0 || revision == SRF02_RANGING_BUSY ||
+			i2c_smbus_read_byte_data (client, CMD_REVISION_REG) >= 0) {
+		printk (KERN_INFO "srf02 - address change 0x%02x -> 0x%02lx failed \n", client->addr, new_addr);
+		ret = -EIO;
+		goto exit_put;
+	}
+
+	printk (KERN_INFO "srf02 - address changed 0x%02x -> 0x%02lx \n", client->addr, new_addr);
+	i2c_lock_adapter (client->adapter);
+	client->addr = new_addr;
+	i2c_unlock_adapter (client->adapter);
+	ret = 0;
+
+	exit_put:
+		srf02_unlock_group (srf02_p);
+		pm_runtime_mark_last_busy (&client->dev);
+		pm_runtime_put_autosuspend (&client->dev);
+
+	exit_unregister_probe:
+		i2c_unregister_device (probe);
+
+	exit_unlock:
+		mutex_unlock (&srf02_p->lock);
+		return ret;
+}
+
+static ssize_t srf02_store_address (struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
+	int ret;
+
+	ret = srf02_change_address (srf02_p, simple_strtoul (buf, NULL, 0));
+
+	return ret < 0 ? ret : size;
+}
+
+static DEVICE_ATTR (i2c_address, 0644, srf02_get_address, srf02_store_address);
 
 
 /**
@@ -220,9 +1146,7 @@ static ssize_t srf02_get_value (struct device *dev, struct device_attribute *att
 
 	//printk (KERN_INFO "srf02 - try to read value \n");
 
-	s32 i2cRet;
-	int value_reg1 = 0;
-	int value_reg2 = 0;
+	int value;
 	int ret_lock = 0;
 
 	ret_lock = spin_trylock(&mylock);
@@ -230,27 +1154,23 @@ static ssize_t srf02_get_value (struct device *dev, struct device_attribute *att
 	//Spinlock acquired
 	if (ret_lock) {
 		//printk (KERN_INFO "srf02 - spinlock acquired, start measurement \n");
-		struct i2c_client *client = to_i2c_client(dev);
-		//Starting measurement in cm
-		// write to command register that measurement shall be in cm
-		i2cRet = i2c_smbus_write_byte_data (client, CMD_COMMAND_REG, CMD_RESULT_IN_CM);
+		struct srf02_priv *srf02_p = dev_get_drvdata (dev);
 
 		//delete spinlock
 		spin_unlock (&mylock);
 
-		if (i2cRet < 0) {
-			printk (KERN_INFO "srf02 - failed setting mode \n");
-			return 0;
-		}
-		//wait for result
-		msleep(100);
+		pm_runtime_get_sync (dev);
+		value = srf02_measure (srf02_p);
+		pm_runtime_mark_last_busy (dev);
+		pm_runtime_put_autosuspend (dev);
 
-		//Reading result
-		value_reg1 = i2c_smbus_read_byte_data (client, CMD_RANGE_HIGH_BYTE);
-		value_reg2 = i2c_smbus_read_byte_data (client, CMD_RANGE_LOW_BYTE);
+		if (value < 0) {
+			printk (KERN_INFO "srf02 - measurement failed (%d) \n", value);
+			return value;
+		}
 
-		printk (KERN_INFO "srf02 - value is : %d \n", ((value_reg1 * 256) + value_reg2));
-		return sprintf (buf, "%d \n", ((value_reg1 * 256) + value_reg2));
+		printk (KERN_INFO "srf02 - value is : %d \n", value);
+		return sprintf (buf, "%d \n", value);
 	}
 	//can not get spinlock
 	else {
@@ -268,17 +1188,20 @@ static ssize_t srf02_store_value (struct device *dev, struct device_attribute *a
 	uint8_t value;
 	struct srf02_priv *srf02_p = i2c_get_clientdata (client);
 
-	s32 value_reg1;
-	s32 value_reg2;
-	s32 i2cRet;
+	u8 range[2];
+	int i2cRet;
 	// (to read a value from userspace)
 	value = simple_strtoul (buf, NULL, 10);
 
 	//Reading result from i2c bus
-	value_reg1 = i2c_smbus_read_byte_data (client, CMD_RANGE_HIGH_BYTE);
-	value_reg2 = i2c_smbus_read_byte_data (client, CMD_RANGE_LOW_BYTE);
+	mutex_lock (&srf02_p->bus_lock);
+	i2cRet = regmap_bulk_read (srf02_p->regmap, CMD_RANGE_HIGH_BYTE, range, sizeof (range));
+	mutex_unlock (&srf02_p->bus_lock);
+	if (i2cRet < 0) {
+		return i2cRet;
+	}
 
-	i2cRet = (value_reg1 * 256) + value_reg2;
+	i2cRet = (range[0] * 256) + range[1];
 
 	//printk (KERN_INFO "srf02 - you try to write : %d \n", value);
 	//printk (KERN_INFO "srf02 - value is : %d \n", i2cRet);
@@ -293,12 +1216,40 @@ static DEVICE_ATTR (srf02value, 0644, srf02_get_value, srf02_store_value);
 
 static const struct attribute *srf02_attrs[] = {
 		&dev_attr_value_now.attr,
+		&dev_attr_period.attr,
+		&dev_attr_ranging_time_us.attr,
+		&dev_attr_min_period_ms.attr,
 		&dev_attr_srf02value.attr,
+		&dev_attr_max_range_mm.attr,
+		&dev_attr_gain.attr,
+		&dev_attr_i2c_address.attr,
+		&dev_attr_unit.attr,
+		&dev_attr_label.attr,
+		&dev_attr_group.attr,
+		&dev_attr_filter_window.attr,
+		&dev_attr_gestures.attr,
+		&dev_attr_id.attr,
 		NULL,
 };
 
+/**
+ * Hide controls the sensor does not have, the fixed max range of the srf02 is read only
+ */
+static umode_t srf02_attr_is_visible (struct kobject *kobj, struct attribute *attr, int index) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (container_of (kobj, struct device, kobj));
+
+	if (attr == &dev_attr_max_range_mm.attr && !srf02_p->variant->has_max_range) {
+		return 0444;
+	}
+	if (attr == &dev_attr_gain.attr && !srf02_p->variant->has_gain) {
+		return 0;
+	}
+	return attr->mode;
+}
+
 static const struct attribute_group srf02_attr_group = {
 		.attrs = srf02_attrs,
+		.is_visible = srf02_attr_is_visible,
 };
 
 /**
@@ -306,8 +1257,13 @@ static const struct attribute_group srf02_attr_group = {
  */
 static int __init srf02_init (void) {
 	int ret;
+	int i;
 	struct device *srf02_device;
 
+	for (i = 0; i < SRF02_MAX_GROUPS; i++) {
+		mutex_init (&srf02_group_lock[i]);
+	}
+
 	ret = alloc_chrdev_region (&dev_num, 0, 1, DEVICE_NAME);
 	if (ret < 0) {
 		printk (KERN_INFO "srf02 - failed to allocate major number \n ");
@@ -349,6 +1305,17 @@ static int __init srf02_init (void) {
 	}
 	//printk (KERN_INFO "srf02 - device in sysfs created \n");
 
+	ret = genl_register_family (&srf02_genl_family);
+	if (ret) {
+		printk (KERN_INFO "srf02 - registering netlink family failed \n");
+		goto exit_failed_genl_family;
+	}
+	ret = genl_register_mc_group (&srf02_genl_family, &srf02_genl_all);
+	if (ret) {
+		printk (KERN_INFO "srf02 - registering netlink group failed \n");
+		goto exit_failed_i2c_add_driver;
+	}
+
 	ret = i2c_add_driver (&srf02_i2c_driver);
 	if (ret != 0) {
 		printk (KERN_INFO "srf02 - i2c_add_driver failed \n");
@@ -356,31 +1323,13 @@ static int __init srf02_init (void) {
 	}
 	printk (KERN_INFO "srf02 - i2c_add_driver successful \n");
 
-	//for input events
-	srf02_input_dev = input_allocate_device();
-	if (!srf02_input_dev) {
-		printk (KERN_INFO "srf02 - can not allocate memory for input-device \n");
-		ret = -ENOMEM;
-	}
-	srf02_input_dev->evbit[0] = BIT_MASK(EV_ABS);
-	srf02_input_dev->name = "SRF02 input event module";
-	input_set_abs_params(srf02_input_dev, ABS_DISTANCE, 15, 700, 1, 0);
-
-	ret = input_register_device(srf02_input_dev);
-
-	if (ret) {
-		printk (KERN_INFO "srf02 - failed to register input device \n");
-		goto exit_free_dev;
-	}
-
-
 	return 0;
 
 
-	exit_free_dev:
-		input_free_device(srf02_input_dev);
-
 	exit_failed_i2c_add_driver:
+		genl_unregister_family (&srf02_genl_family);
+
+	exit_failed_genl_family:
 
 	exit_failed_device_create:
 		if (srf02dev) {
@@ -404,8 +1353,6 @@ static int __init srf02_init (void) {
  */
 static void __exit srf02_exit (void) {
 
-	input_unregister_device(srf02_input_dev);
-
 	if (srf02dev) {
 		cdev_del (srf02dev);
 	}
@@ -418,16 +1365,56 @@ static void __exit srf02_exit (void) {
 	unregister_chrdev_region(dev_num, 1);
 
 	i2c_del_driver(&srf02_i2c_driver);
+
+	// also removes all multicast groups
+	genl_unregister_family (&srf02_genl_family);
 }
 
 module_init(srf02_init);
 module_exit(srf02_exit);
 
 
+/**
+ * Detect srf02 sensors on the adapters given in scan_bus. Only reads: the revision register must not read
+ * as busy and the unused register 1 always reads 0x80.
+ */
+static int srf02_detect (struct i2c_client *client, struct i2c_board_info *info) {
+	struct i2c_adapter *adapter = client->adapter;
+	bool configured = false;
+	s32 revision;
+	int i;
+
+	for (i = 0; i < scan_bus_count; i++) {
+		if (scan_bus[i] == adapter->nr) {
+			configured = true;
+		}
+	}
+	if (!configured || !i2c_check_functionality (adapter, I2C_FUNC_SMBUS_BYTE_DATA)) {
+		return -ENODEV;
+	}
+	if (client->addr < SRF02_FIRST_ADDRESS || client->addr > SRF02_LAST_DETECT_ADDRESS) {
+		return -ENODEV;
+	}
+
+	revision = i2c_smbus_read_byte_data (client, CMD_REVISION_REG);
+	if (revision < 0 || revision == SRF02_RANGING_BUSY) {
+		return -ENODEV;
+	}
+	if (i2c_smbus_read_byte_data (client, CMD_UNUSED_REG) != SRF02_UNUSED_REG_VALUE) {
+		return -ENODEV;
+	}
+
+	printk (KERN_INFO "srf02 - found sensor at %d-%04x, revision %d \n", adapter->nr, client->addr, revision);
+	strlcpy (info->type, "srf02", I2C_NAME_SIZE);
+	return 0;
+}
+
+
 /**
  * Modprobe function for srf02 - create srf02value file!
  */
 static int srf02_i2c_probe (struct i2c_client *client, const struct i2c_device_id *id) {
+	struct srf02_platform_data *pdata = client->dev.platform_data;
 	struct srf02_priv *srf02_p;
 	int ret = 0;
 
@@ -439,6 +1426,7 @@ static int srf02_i2c_probe (struct i2c_client *client, const struct i2c_device_i
 	}
 
 	srf02_p->client = client;
+	srf02_p->variant = &srf02_variants[id->driver_data];
 
 	i2c_set_clientdata(client, srf02_p);
 	srf02_p = i2c_get_clientdata(client);
@@ -448,31 +1436,175 @@ static int srf02_i2c_probe (struct i2c_client *client, const struct i2c_device_i
 	//printk (KERN_INFO "srf02->client->addr %d \n", srf02_p->client->addr);
 
 
+	srf02_p->regmap = regmap_init_i2c (client, &srf02_regmap_config);
+	if (IS_ERR (srf02_p->regmap)) {
+		printk (KERN_INFO "srf02 - init regmap failed \n ");
+		ret = PTR_ERR (srf02_p->regmap);
+		kfree (srf02_p);
+		return ret;
+	}
+
 	srf02_client = srf02_p->client;
 
+	srf02_p->id = ida_simple_get (&srf02_ida, 0, 0, GFP_KERNEL);
+	if (srf02_p->id < 0) {
+		ret = srf02_p->id;
+		goto exit_failed_init_input;
+	}
+
+	mutex_init (&srf02_p->lock);
+	mutex_init (&srf02_p->bus_lock);
+	srf02_p->value_nonstop = -1;
+	srf02_p->period_ms = SRF02_DEFAULT_PERIOD_MS;
+	srf02_p->enabled = false;
+	srf02_p->resume_enabled = false;
+	srf02_p->failures = 0;
+	srf02_p->sequence = 0;
+	srf02_p->max_range_mm = srf02_p->variant->max_range_mm;
+	srf02_p->gain = srf02_p->variant->max_gain;
+	srf02_p->unit = SRF02_UNIT_CM;
+	srf02_p->group = 0;
+	srf02_p->label = NULL;
+	srf02_p->filter_window = 1;
+	srf02_p->gestures_enabled = false;
+
+	// board specific defaults
+	if (pdata) {
+		if (pdata->period_ms) {
+			srf02_p->period_ms = pdata->period_ms;
+		}
+		if (pdata->unit < ARRAY_SIZE (srf02_unit_cmd)) {
+			srf02_p->unit = pdata->unit;
+		}
+		if (pdata->filter_window) {
+			srf02_p->filter_window = min (pdata->filter_window, (unsigned int) SRF02_MAX_FILTER_WINDOW);
+		}
+		if (pdata->max_range_mm && srf02_p->variant->has_max_range) {
+			srf02_p->max_range_mm = srf02_clamp_max_range (srf02_p->variant, pdata->max_range_mm);
+		}
+		if (pdata->group <= SRF02_MAX_GROUPS) {
+			srf02_p->group = pdata->group;
+		}
+		srf02_p->label = pdata->label;
+		srf02_p->gestures_enabled = pdata->gestures;
+	}
+	srf02_p->ranging_overhead_us = SRF02_RANGING_OVERHEAD_MS * 1000;
+	srf02_p->measured_ranging_us = 0;
+	srf02_p->ranging_time_ms = srf02_ranging_time_ms (srf02_p);
+
+	ret = srf02_apply_range_settings (srf02_p);
+	if (ret < 0) {
+		printk (KERN_INFO "srf02 - %s not responding \n ", srf02_p->variant->name);
+		goto exit_failed_init_input;
+	}
+
+	// measure the real ranging time, the defaults from the data sheet stay if that fails
+	ret = srf02_characterize (srf02_p);
+	if (ret < 0) {
+		printk (KERN_INFO "srf02 - characterizing ranging time failed (%d) \n ", ret);
+	}
+	srf02_apply_range_settings (srf02_p);
+
+	//for input events
+	srf02_p->input_dev = input_allocate_device();
+	if (!srf02_p->input_dev) {
+		printk (KERN_INFO "srf02 - can not allocate memory for input-device \n");
+		ret = -ENOMEM;
+		goto exit_failed_init_input;
+	}
+	srf02_p->input_dev->evbit[0] = BIT_MASK(EV_ABS) | BIT_MASK(EV_MSC);
+	__set_bit(MSC_RAW, srf02_p->input_dev->mscbit);
+	__set_bit(MSC_SERIAL, srf02_p->input_dev->mscbit);
+	srf02_p->input_dev->name = "SRF02 input event module";
+	srf02_p->input_dev->phys = srf02_p->variant->name;
+	srf02_p->input_dev->id.bustype = BUS_I2C;
+	srf02_p->input_dev->dev.parent = &client->dev;
+	input_set_abs_params(srf02_p->input_dev, ABS_DISTANCE,
+			srf02_mm_to_unit (srf02_p, srf02_p->variant->min_range_cm * 10),
+			srf02_mm_to_unit (srf02_p, srf02_p->variant->max_range_mm), 1, 0);
+
+	ret = input_register_device(srf02_p->input_dev);
+	if (ret) {
+		printk (KERN_INFO "srf02 - failed to register input device \n");
+		input_free_device(srf02_p->input_dev);
+		goto exit_failed_init_input;
+	}
+
+	// separate device for gestures, so user space only wakes up on gestures
+	srf02_p->gesture_dev = input_allocate_device();
+	if (!srf02_p->gesture_dev) {
+		printk (KERN_INFO "srf02 - can not allocate memory for gesture input-device \n");
+		ret = -ENOMEM;
+		goto exit_failed_init_gesture;
+	}
+	srf02_p->gesture_dev->evbit[0] = BIT_MASK(EV_KEY) | BIT_MASK(EV_SW);
+	__set_bit(SW_FRONT_PROXIMITY, srf02_p->gesture_dev->swbit);
+	__set_bit(SRF02_KEY_WAVE, srf02_p->gesture_dev->keybit);
+	srf02_p->gesture_dev->name = "SRF02 gesture module";
+	srf02_p->gesture_dev->phys = srf02_p->variant->name;
+	srf02_p->gesture_dev->id.bustype = BUS_I2C;
+	srf02_p->gesture_dev->dev.parent = &client->dev;
+
+	ret = input_register_device(srf02_p->gesture_dev);
+	if (ret) {
+		printk (KERN_INFO "srf02 - failed to register gesture input device \n");
+		input_free_device(srf02_p->gesture_dev);
+		goto exit_failed_init_gesture;
+	}
+
+	// workqueue and work item for cyclic measurement, allocated once for the lifetime of the device
+	srf02_p->wq = create_singlethread_workqueue (DEVICE_NAME);
+	if (!srf02_p->wq) {
+		printk (KERN_INFO "srf02 - creating workqueue failed \n ");
+		ret = -ENOMEM;
+		goto exit_failed_create_wq;
+	}
+	INIT_DELAYED_WORK (&srf02_p->work, workq_fn);
+
+	// netlink group for consumers of only this sensor
+	snprintf (srf02_p->genl_group.name, GENL_NAMSIZ, "sensor%d", srf02_p->id);
+	ret = genl_register_mc_group (&srf02_genl_family, &srf02_p->genl_group);
+	if (ret) {
+		printk (KERN_INFO "srf02 - registering netlink group failed \n ");
+		goto exit_failed_init_sysfs;
+	}
+
 	//create srf02value entry
 	ret = sysfs_create_group (&client -> dev.kobj, &srf02_attr_group);
 	if (ret) {
 		printk (KERN_INFO "srf02 - init sysfs failed \n ");
-		goto exit_failed_init_sysfs;
+		goto exit_failed_init_genl;
 	}
 	//printk (KERN_INFO "srf02 - init sysfs probe function success \n");
 
-#ifdef CONFIG_EARLYSUSPEND
-	srf02_p->es_handler.level = EARLY_SUSPEND_LEVEL_DISABLE_FB;
-	srf02_p->es_handler.suspend = srf02_early_suspend;
-	srf02_p->es_handler.resume = srf02_later_resume;
-	srf02_p->es_handler.data = (void *)client;
-	register_early_suspend(&srf02_p->es_handler);
-
-#endif
+	// sensor is idle until sampling gets enabled, let the adapter suspend in between
+	pm_runtime_set_active (&client->dev);
+	pm_runtime_set_autosuspend_delay (&client->dev, SRF02_AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend (&client->dev);
+	pm_runtime_enable (&client->dev);
 
 	return 0;
 
+	exit_failed_init_genl:
+		genl_unregister_mc_group (&srf02_genl_family, &srf02_p->genl_group);
+
 	exit_failed_init_sysfs:
+		destroy_workqueue (srf02_p->wq);
+
+	exit_failed_create_wq:
+		input_unregister_device (srf02_p->gesture_dev);
+
+	exit_failed_init_gesture:
+		input_unregister_device (srf02_p->input_dev);
+
+	exit_failed_init_input:
+		if (srf02_p->id >= 0) {
+			ida_simple_remove (&srf02_ida, srf02_p->id);
+		}
+		regmap_exit (srf02_p->regmap);
 		kfree(srf02_p);
 		srf02_client = NULL;
-		return -1;
+		return ret;
 }
 
 /**
@@ -481,64 +1613,94 @@ static int srf02_i2c_probe (struct i2c_client *client, const struct i2c_device_i
 static int srf02_i2c_remove (struct i2c_client *client) {
 	struct srf02_priv *srf02_p = i2c_get_clientdata (client);
 
-#ifdef CONFIG_EARLYSUSPEND
-	unregister_early_suspend(&srf02_p->es_handler);
-#endif
-
 	sysfs_remove_group(&client->dev.kobj, &srf02_attr_group);
 	//printk (KERN_INFO "srf02 - removed sysfs group \n");
+
+	mutex_lock (&srf02_p->lock);
+	srf02_stop_sampling (srf02_p);
+	mutex_unlock (&srf02_p->lock);
+
+	pm_runtime_disable (&client->dev);
+	pm_runtime_dont_use_autosuspend (&client->dev);
+	pm_runtime_set_suspended (&client->dev);
+
+	destroy_workqueue (srf02_p->wq);
+	genl_unregister_mc_group (&srf02_genl_family, &srf02_p->genl_group);
+	ida_simple_remove (&srf02_ida, srf02_p->id);
+	input_unregister_device (srf02_p->gesture_dev);
+	input_unregister_device (srf02_p->input_dev);
+	regmap_exit (srf02_p->regmap);
+	if (srf02_client == client) {
+		srf02_client = NULL;
+	}
 	kfree (srf02_p);
 	return 0;
 }
 
 
-#ifdef CONFIG_HAS_EARLYSUSPEND
-
-static void srf02_early_suspend (struct early_suspend *suspend) {
-	struct srf02_priv *srf02_p;
-	s32 i2cRet;
+#ifdef CONFIG_PM_SLEEP
 
-	//printk (KERN_INFO "srf02 - early suspend started \n");
+/**
+ * System suspend, remember whether cyclic measurement was running and stop it
+ */
+static int srf02_suspend (struct device *dev) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
 
-	if (suspend->data) {
-		srf02_p = i2c_get_clientdata((struct i2c_client *) suspend->data);
-		// save all important things here for starting suspend mode
-		// stop queue
-		cancel_delayed_work ((struct delayed_work *)work);
+	mutex_lock (&srf02_p->lock);
+	srf02_p->resume_enabled = srf02_p->enabled;
+	if (srf02_p->enabled) {
+		cancel_delayed_work_sync (&srf02_p->work);
 	}
+	mutex_unlock (&srf02_p->lock);
+
+	return 0;
 }
 
-static void srf02_later_resume (struct early_suspend *suspend) {
-	struct srf02_priv *srf02_p;
-	s32 i2cRet;
+/**
+ * System resume, restore gain and max range and restart cyclic measurement with the saved period
+ * if it was running before suspend. Median filter and gestures start over, the scene may have
+ * changed completely while the system slept.
+ */
+static int srf02_resume (struct device *dev) {
+	struct srf02_priv *srf02_p = dev_get_drvdata (dev);
 
-	if (suspend->data) {
-		srf02_p = i2c_get_clientdata ((struct i2c_client *) suspend->data);
-		// wake up all important things, restore saved values...
-		// write workfunction again to the queue
-		my_wq = create_workqueue("my_workqueue");
-       		if (my_wq) {
-        		work = (my_work_t *) kmalloc (sizeof (my_work_t), GFP_KERNEL);
-               		if (work) {
-                               	INIT_DELAYED_WORK ((struct delayed_work *) work, workq_fn);
-                                queue_delayed_work(my_wq, (struct delayed_work *) work,	msecs_to_jiffies(100));
-                       	}
-                 }
+	mutex_lock (&srf02_p->lock);
+	if (srf02_apply_range_settings (srf02_p) < 0) {
+		printk (KERN_INFO "srf02 - restoring range settings failed \n");
 	}
+	srf02_filter_reset (srf02_p);
+	srf02_gesture_reset (srf02_p);
+	if (srf02_p->resume_enabled) {
+		queue_delayed_work (srf02_p->wq, &srf02_p->work, msecs_to_jiffies(srf02_p->period_ms));
+	}
+	srf02_p->resume_enabled = false;
+	mutex_unlock (&srf02_p->lock);
+
+	return 0;
 }
 
-#else
+#endif
+
+#ifdef CONFIG_PM_RUNTIME
 
-static void srf02_early_suspend (struct early_suspend *suspend) {
-	// nothing to do
+/**
+ * The srf02 has no power down mode, runtime PM only tells the bus that the sensor is idle
+ */
+static int srf02_runtime_suspend (struct device *dev) {
+	return 0;
 }
 
-static void srf02_later_resume (struct early_suspend *suspend) {
-	// nothing to do
+static int srf02_runtime_resume (struct device *dev) {
+	return 0;
 }
 
 #endif
 
+static const struct dev_pm_ops srf02_pm_ops = {
+		SET_SYSTEM_SLEEP_PM_OPS (srf02_suspend, srf02_resume)
+		SET_RUNTIME_PM_OPS (srf02_runtime_suspend, srf02_runtime_resume, NULL)
+};
+
 
 /**
  * Standard functions to access the driver
@@ -570,9 +1732,9 @@ static int srf02_release (struct inode *inode, struct file *file) {
 static ssize_t srf02_write (struct file *file, const char *buf, size_t length, loff_t *offset) {
 	//printk (KERN_INFO "srf02 - try to write file - i do not like if you try to change measured values \n");
 
-	struct srf02_priv *srf02_p;
-	struct i2c_client *client;
-	s32 i2cRet;
+	struct srf02_priv *srf02_p = NULL;
+	struct i2c_client *client = NULL;
+	int i2cRet;
 
 	int bytes_written;
 	int max_bytes = 2;
@@ -610,8 +1772,9 @@ static ssize_t srf02_write (struct file *file, const char *buf, size_t length, l
 			index_command_buffer = index_command_buffer + 2;
 		}
 
-		i2cRet = i2c_smbus_write_byte_data (client, buffer [0], buffer [1]);
-		//printk (KERN_INFO "srf02 - write () - i2c_smbus_write_byte_data : %d \n", i2cRet);
+		// regmap rejects writes to everything but the command register
+		i2cRet = regmap_write (srf02_p->regmap, buffer [0], buffer [1]);
+		//printk (KERN_INFO "srf02 - write () - regmap_write : %d \n", i2cRet);
 
 		return i2cRet;
 	}
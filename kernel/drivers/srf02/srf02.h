@@ -22,12 +22,63 @@
 
 
 #define CMD_COMMAND_REG      (0x00)
+#define CMD_REVISION_REG     (0x00)
+#define CMD_UNUSED_REG       (0x01)
 #define CMD_RANGE_HIGH_BYTE  (0x02)
 #define CMD_RANGE_LOW_BYTE   (0x03)
+#define CMD_MIN_RANGE_HIGH_BYTE (0x04)
+#define CMD_MIN_RANGE_LOW_BYTE  (0x05)
+#define CMD_LAST_ECHO_LOW_BYTE  (0x23)
+
+/* srf08 / srf10 only, write only, reading those addresses returns light sensor / range */
+#define CMD_GAIN_REG         (0x01)
+#define CMD_MAX_RANGE_REG    (0x02)
+
+#define SRF08_RANGE_STEP_MM  (43)
+#define SRF08_MAX_RANGE_MM   (256 * SRF08_RANGE_STEP_MM)
+#define SPEED_OF_SOUND_MM_PER_MS (343)
 #define CMD_RESULT_IN_INCHES (0x50)
 #define CMD_RESULT_IN_CM     (0x51)
 #define CMD_RESULT_IN_MS     (0x52)
 
+/* address change: write these three commands, then the new 8 bit address, to the command register */
+#define CMD_CHANGE_ADDRESS_1 (0xA0)
+#define CMD_CHANGE_ADDRESS_2 (0xAA)
+#define CMD_CHANGE_ADDRESS_3 (0xA5)
+
+#define SRF02_FIRST_ADDRESS  (0x70)
+#define SRF02_LAST_ADDRESS   (0x7F)
+#define SRF02_LAST_DETECT_ADDRESS (0x77)	// i2c core does not probe above 0x77
+#define SRF02_UNUSED_REG_VALUE (0x80)
+
+
+enum srf02_type {
+	SRF02,
+	SRF08,
+	SRF10,
+};
+
+/* What differs between the supported sensors */
+struct srf02_variant {
+	const char *name;
+	unsigned int min_range_cm;
+	unsigned int max_range_mm;	// max range, upper limit for max_range_mm on srf08 / srf10
+	unsigned int ranging_time_ms;	// fixed ranging time of sensors without max range register
+	unsigned int max_gain;
+	unsigned int max_register;
+	bool has_gain;
+	bool has_max_range;
+};
+
+/* state of the gesture detector */
+struct srf02_gesture {
+	ktime_t last_time;
+	ktime_t near_since;
+	int last_mm;
+	int velocity;		// mm/s, negative while approaching
+	bool has_last;
+	bool near;
+};
 
 struct srf02_priv;
 static struct i2c_board_info srf02_info;
@@ -35,6 +86,7 @@ static struct i2c_board_info srf02_info;
 
 static int srf02_i2c_probe (struct i2c_client *client, const struct i2c_device_id *id);
 static int srf02_i2c_remove (struct i2c_client *client);
+static int srf02_detect (struct i2c_client *client, struct i2c_board_info *info);
 
 static int srf02_open (struct inode *inode, struct file *file);
 static int srf02_release (struct inode *inode, struct file *file);
@@ -44,7 +96,6 @@ static ssize_t srf02_read (struct file *file, char *buf, size_t length, loff_t *
 
 static const struct file_operations srf02_fops;
 
-static void srf02_early_suspend (struct early_suspend *suspend);
-static void srf02_later_resume (struct early_suspend *suspend);
+static const struct dev_pm_ops srf02_pm_ops;
 
 #endif
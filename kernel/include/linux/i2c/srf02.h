@@ -0,0 +1,49 @@
+/* ------------------------------------------------------------------------- */
+/*   Copyright (C) 2015 Anna-Lena Marx
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.		     */
+/* ------------------------------------------------------------------------- */
+
+
+#ifndef __LINUX_I2C_SRF02_H__
+#define __LINUX_I2C_SRF02_H__
+
+#include <linux/types.h>
+#include <linux/srf02.h>
+
+
+#define SRF02_MAX_FILTER_WINDOW	(7)
+#define SRF02_MAX_GROUPS	(8)
+
+/* key reported on the gesture input device for a wave, approach / withdraw toggle SW_FRONT_PROXIMITY */
+#define SRF02_KEY_WAVE		KEY_PROG1
+
+/*
+ * Board specific defaults for one srf02 / srf08 / srf10. period_ms, filter_window, max_range_mm and
+ * gestures can still be changed in sysfs, unit, label and group are fixed at probe.
+ * Fields left 0 keep the driver defaults.
+ */
+struct srf02_platform_data {
+	unsigned int period_ms;		// time between the start of two measurements
+	enum srf02_unit unit;
+	unsigned int filter_window;	// median over that many samples, 0 or 1 disables the filter
+	unsigned int max_range_mm;	// srf08 / srf10 only
+	unsigned int group;		// sensors of the same group (1..SRF02_MAX_GROUPS) never range at the same time
+	const char *label;		// mounting position, e.g. "front"
+	bool gestures;			// report approach / withdraw / wave on the gesture input device
+};
+
+
+#endif
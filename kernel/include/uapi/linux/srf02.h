@@ -0,0 +1,67 @@
+/* ------------------------------------------------------------------------- */
+/*   Copyright (C) 2015 Anna-Lena Marx
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.		     */
+/* ------------------------------------------------------------------------- */
+
+
+#ifndef _UAPI_LINUX_SRF02_H
+#define _UAPI_LINUX_SRF02_H
+
+#include <linux/types.h>
+
+/*
+ * Interface of the srf02 driver to user space. Board configuration is in <linux/i2c/srf02.h>.
+ */
+
+/* unit of the reported distance */
+enum srf02_unit {
+	SRF02_UNIT_CM = 0,
+	SRF02_UNIT_INCH,
+	SRF02_UNIT_US,		// echo time in us
+};
+
+/*
+ * Generic netlink interface. Every sample is multicast as one SRF02_CMD_SAMPLE message carrying a
+ * struct srf02_sample in SRF02_ATTR_SAMPLE. Join group "samples" for all sensors or "sensor<id>"
+ * (id from the sysfs attribute "id") for a single one.
+ */
+#define SRF02_GENL_NAME		"SRF02"
+#define SRF02_GENL_VERSION	(1)
+#define SRF02_GENL_GROUP_ALL	"samples"
+
+enum {
+	SRF02_CMD_UNSPEC,
+	SRF02_CMD_SAMPLE,
+};
+
+enum {
+	SRF02_ATTR_UNSPEC,
+	SRF02_ATTR_SAMPLE,	// struct srf02_sample
+	__SRF02_ATTR_MAX,
+};
+#define SRF02_ATTR_MAX (__SRF02_ATTR_MAX - 1)
+
+#define SRF02_SAMPLE_INVALID	(1 << 0)	// measurement failed, value is the negative errno
+
+struct srf02_sample {
+	__u64 timestamp_ns;	// CLOCK_MONOTONIC
+	__s32 value;		// distance in unit
+	__u16 sensor;
+	__u8 unit;		// enum srf02_unit
+	__u8 flags;
+};
+
+#endif